@@ -0,0 +1,239 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <config.h>
+
+#ifdef ENABLE_ALLOC_STATS
+
+#include <algorithm>            // max()
+#include <cinttypes>            // PRIu64
+#include <cstdio>               // snprintf()
+#include <cstdlib>              // aligned_alloc(), free(), malloc()
+#include <cstring>              // memcpy()
+#include <mutex>
+#include <new>
+
+#include "alloc_stats.hpp"
+
+
+namespace alloc_stats {
+
+    namespace {
+
+        const std::size_t class_limits[num_classes - 1] = {
+            16, 64, 256, 1024, 4 * 1024, 64 * 1024, 1024 * 1024
+        };
+
+        // The block size is stored right before the pointer returned.
+        constexpr std::size_t header_size = alignof(std::max_align_t);
+
+        // Counters are 64-bit, which isn't lock-free on the Wii U.
+        std::mutex counters_mutex;
+        totals counters;
+
+
+        std::size_t
+        class_index(std::size_t size)
+            noexcept
+        {
+            std::size_t i = 0;
+            while (i < num_classes - 1 && size > class_limits[i])
+                ++i;
+            return i;
+        }
+
+
+        void
+        add(std::size_t size)
+            noexcept
+        {
+            std::lock_guard lock{counters_mutex};
+            ++counters.allocs;
+            counters.bytes += size;
+            ++counters.live_blocks;
+            counters.live_bytes += size;
+            counters.peak_bytes = std::max(counters.peak_bytes, counters.live_bytes);
+            auto& sc = counters.classes[class_index(size)];
+            ++sc.allocs;
+            sc.bytes += size;
+            ++sc.live;
+        }
+
+
+        void
+        remove(std::size_t size)
+            noexcept
+        {
+            std::lock_guard lock{counters_mutex};
+            ++counters.frees;
+            --counters.live_blocks;
+            counters.live_bytes -= size;
+            --counters.classes[class_index(size)].live;
+        }
+
+
+        // Stores the size in the header, and returns the pointer past it.
+        void*
+        track(void* raw,
+              std::size_t offset,
+              std::size_t size)
+            noexcept
+        {
+            auto user = static_cast<char*>(raw) + offset;
+            std::memcpy(user - sizeof size, &size, sizeof size);
+            add(size);
+            return user;
+        }
+
+
+        // Returns the pointer originally allocated.
+        void*
+        untrack(void* ptr,
+                std::size_t offset)
+            noexcept
+        {
+            auto user = static_cast<char*>(ptr);
+            std::size_t size;
+            std::memcpy(&size, user - sizeof size, sizeof size);
+            remove(size);
+            return user - offset;
+        }
+
+
+        template<typename Alloc>
+        void*
+        allocate(Alloc alloc)
+        {
+            for (;;) {
+                if (void* raw = alloc())
+                    return raw;
+                auto handler = std::get_new_handler();
+                if (!handler)
+                    throw std::bad_alloc{};
+                handler();
+            }
+        }
+
+    } // namespace
+
+
+    totals
+    get()
+        noexcept
+    {
+        std::lock_guard lock{counters_mutex};
+        return counters;
+    }
+
+
+    std::size_t
+    class_limit(std::size_t index)
+        noexcept
+    {
+        return index < num_classes - 1 ? class_limits[index] : 0;
+    }
+
+
+    void
+    report(void (*print_line)(const char* line))
+        noexcept
+    {
+        const totals t = get();
+        char line[128];
+        std::snprintf(line, sizeof line,
+                      "heap: %" PRIu64 " allocs, %" PRIu64 " frees, %" PRIu64 " KiB total",
+                      t.allocs, t.frees, t.bytes / 1024);
+        print_line(line);
+        std::snprintf(line, sizeof line,
+                      "heap: %" PRIu64 " live blocks, %" PRIu64 " KiB live, %" PRIu64 " KiB peak",
+                      t.live_blocks, t.live_bytes / 1024, t.peak_bytes / 1024);
+        print_line(line);
+        for (std::size_t i = 0; i < num_classes; ++i) {
+            const auto& sc = t.classes[i];
+            if (!sc.allocs)
+                continue;
+            const std::size_t limit = class_limit(i) ? class_limit(i) : class_limits[i - 1];
+            std::snprintf(line, sizeof line,
+                          "  %s %7zu B: %" PRIu64 " allocs, %" PRIu64 " KiB, %" PRIu64 " live",
+                          class_limit(i) ? "<=" : "> ",
+                          limit, sc.allocs, sc.bytes / 1024, sc.live);
+            print_line(line);
+        }
+    }
+
+} // namespace alloc_stats
+
+
+using namespace alloc_stats;
+
+
+/*
+ * The array and nothrow forms from libstdc++ forward to these. The sized forms do too,
+ * but GCC wants them replaced along with the unsized ones.
+ */
+
+void*
+operator new(std::size_t size)
+{
+    void* raw = allocate([size] { return std::malloc(header_size + size); });
+    return track(raw, header_size, size);
+}
+
+
+void
+operator delete(void* ptr)
+    noexcept
+{
+    if (ptr)
+        std::free(untrack(ptr, header_size));
+}
+
+
+void*
+operator new(std::size_t size,
+             std::align_val_t al)
+{
+    const auto align = std::max(static_cast<std::size_t>(al), header_size);
+    // aligned_alloc() needs a multiple of the alignment.
+    const std::size_t total = (align + size + align - 1) / align * align;
+    void* raw = allocate([align, total] { return std::aligned_alloc(align, total); });
+    return track(raw, align, size);
+}
+
+
+void
+operator delete(void* ptr,
+                std::align_val_t al)
+    noexcept
+{
+    const auto align = std::max(static_cast<std::size_t>(al), header_size);
+    if (ptr)
+        std::free(untrack(ptr, align));
+}
+
+
+
+void
+operator delete(void* ptr,
+                std::size_t)
+    noexcept
+{
+    operator delete(ptr);
+}
+
+
+void
+operator delete(void* ptr,
+                std::size_t,
+                std::align_val_t al)
+    noexcept
+{
+    operator delete(ptr, al);
+}
+
+#endif // ENABLE_ALLOC_STATS
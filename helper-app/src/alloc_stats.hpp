@@ -0,0 +1,60 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+ * Counts the allocations made through the global operator new and delete. Only built
+ * when configured with --enable-alloc-stats (ENABLE_ALLOC_STATS defined), since it adds
+ * a small header to every allocation.
+ */
+
+namespace alloc_stats {
+
+    // Blocks up to 16 bytes, 64, 256, 1 KiB, 4 KiB, 64 KiB, 1 MiB, and larger.
+    constexpr std::size_t num_classes = 8;
+
+
+    struct size_class {
+        std::uint64_t allocs = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t live = 0;
+    };
+
+
+    struct totals {
+        std::uint64_t allocs = 0;
+        std::uint64_t frees = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t live_blocks = 0;
+        std::uint64_t live_bytes = 0;
+        std::uint64_t peak_bytes = 0;
+        std::array<size_class, num_classes> classes{};
+    };
+
+
+    // Thread-safe.
+    totals get() noexcept;
+
+
+    // Upper limit of the size class, 0 for the last one.
+    std::size_t class_limit(std::size_t index) noexcept;
+
+
+    // Formats the totals in a few lines, without allocating.
+    void report(void (*print_line)(const char* line)) noexcept;
+
+} // namespace alloc_stats
+
+#endif
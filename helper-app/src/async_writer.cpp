@@ -0,0 +1,182 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <algorithm>            // min()
+#include <cstdint>
+#include <cstdio>
+#include <cstring>              // memcpy()
+#include <memory>
+#include <new>                  // align_val_t
+#include <stdexcept>
+#include <utility>              // move()
+
+#include "async_writer.hpp"
+#include "timing.hpp"
+
+
+using std::filesystem::path;
+
+
+namespace {
+
+    // The SD card driver can DMA straight from buffers with this alignment.
+    const std::size_t io_alignment = 0x40;
+
+    const std::size_t chunk_size = 1024 * 1024;
+
+
+    struct file_closer {
+        void
+        operator ()(std::FILE* f)
+            const noexcept
+        {
+            std::fclose(f);
+        }
+    };
+
+    using file_ptr = std::unique_ptr<std::FILE, file_closer>;
+
+
+    struct aligned_deleter {
+        void
+        operator ()(std::byte* p)
+            const noexcept
+        {
+            ::operator delete[](p, std::align_val_t{io_alignment});
+        }
+    };
+
+    using aligned_buffer = std::unique_ptr<std::byte[], aligned_deleter>;
+
+} // namespace
+
+
+async_writer::async_writer(std::size_t max_queued) :
+    max_queued{max_queued},
+    thread{&async_writer::run, this}
+{}
+
+
+async_writer::~async_writer()
+{
+    {
+        std::lock_guard guard{mutex};
+        stopping = true;
+    }
+    items_cv.notify_all();
+    thread.join();
+}
+
+
+void
+async_writer::push(const std::string& name,
+                   const path& dest,
+                   std::vector<std::byte>&& data)
+{
+    const std::size_t size = data.size();
+    {
+        std::unique_lock lock{mutex};
+        space_cv.wait(lock, [this, size]
+        {
+            return !queued || queued + size <= max_queued;
+        });
+        queue.push_back({name, dest, std::move(data)});
+        queued += size;
+    }
+    items_cv.notify_one();
+}
+
+
+void
+async_writer::wait()
+{
+    std::unique_lock lock{mutex};
+    space_cv.wait(lock, [this] { return !queued; });
+}
+
+
+std::vector<async_writer::result>
+async_writer::take_results()
+{
+    std::lock_guard guard{mutex};
+    return std::move(results);
+}
+
+
+void
+async_writer::run()
+{
+    // Only used for data that is not already aligned.
+    aligned_buffer staging;
+
+    for (;;) {
+        item it;
+        {
+            std::unique_lock lock{mutex};
+            items_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            it = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        result res{it.name, it.dest, it.data.size(), {}};
+        try {
+            const bool aligned =
+                reinterpret_cast<std::uintptr_t>(it.data.data()) % io_alignment == 0;
+            if (!aligned && !staging)
+                staging.reset(new (std::align_val_t{io_alignment}) std::byte[chunk_size]);
+
+            timing::scope t{it.name, timing::phase::save, it.data.size()};
+
+            path tmp_path = it.dest;
+            tmp_path += ".tmp";
+            try {
+                {
+                    file_ptr f{std::fopen(tmp_path.c_str(), "wb")};
+                    if (!f)
+                        throw std::runtime_error{"unable to open for writing"};
+                    // Every fwrite() is a full chunk, no need for stdio buffering.
+                    std::setvbuf(f.get(), nullptr, _IONBF, 0);
+                    for (std::size_t offset = 0; offset < it.data.size();) {
+                        const std::size_t len = std::min(chunk_size, it.data.size() - offset);
+                        const std::byte* src = it.data.data() + offset;
+                        if (!aligned) {
+                            std::memcpy(staging.get(), src, len);
+                            src = staging.get();
+                        }
+                        if (std::fwrite(src, 1, len, f.get()) != len)
+                            throw std::runtime_error{"unable to write all data"};
+                        offset += len;
+                    }
+                    if (std::fclose(f.release()))
+                        throw std::runtime_error{"error writing file"};
+                }
+                std::remove(it.dest.c_str());
+                if (std::rename(tmp_path.c_str(), it.dest.c_str()))
+                    throw std::runtime_error{"unable to rename temporary file"};
+            }
+            catch (...) {
+                std::remove(tmp_path.c_str());
+                throw;
+            }
+        }
+        catch (std::exception& e) {
+            res.error = e.what();
+        }
+
+        // Free the memory before letting more data in.
+        it.data = std::vector<std::byte>{};
+        {
+            std::lock_guard guard{mutex};
+            queued -= res.size;
+            results.push_back(std::move(res));
+        }
+        space_cv.notify_all();
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef ASYNC_WRITER_HPP
+#define ASYNC_WRITER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/*
+ * Saves files on a background thread, so the next file can be processed while the
+ * previous one is written to the SD card.
+ *
+ * Each file is written with a ".tmp" suffix, and only renamed when complete.
+ */
+class async_writer {
+
+public:
+
+    struct result {
+        std::string name;
+        std::filesystem::path dest;
+        std::size_t size;
+        std::string error;      // empty on success
+    };
+
+private:
+
+    struct item {
+        std::string name;
+        std::filesystem::path dest;
+        std::vector<std::byte> data;
+    };
+
+    const std::size_t max_queued;
+
+    std::mutex mutex;
+    std::condition_variable items_cv;
+    std::condition_variable space_cv;
+    std::deque<item> queue;
+    std::size_t queued = 0;     // bytes in the queue, and being written
+    bool stopping = false;
+    std::vector<result> results;
+
+    std::thread thread;
+
+
+    void run();
+
+public:
+
+    // max_queued is how many bytes can wait to be written.
+    explicit
+    async_writer(std::size_t max_queued);
+
+    ~async_writer();
+
+
+    /*
+     * Blocks while the queue is full. A file bigger than the cap is still accepted
+     * when nothing else is queued.
+     */
+    void push(const std::string& name,
+              const std::filesystem::path& dest,
+              std::vector<std::byte>&& data);
+
+    // Waits until every queued file is written.
+    void wait();
+
+    // Returns the files written (or failed) since the last call.
+    std::vector<result> take_results();
+
+};
+
+#endif
@@ -8,9 +8,14 @@
 
 // Loosely inspired by the code from Flips
 
+#include <algorithm>            // min(), reverse(), upper_bound()
+#include <condition_variable>
 #include <cstring>
+#include <limits>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
 
 #include "bps.hpp"
 #include "crc32.hpp"
@@ -217,17 +222,21 @@ namespace bps {
 
     struct byte_ostream {
 
-        std::vector<byte>& data_vec;
+        span<byte> data_span;
+        span_size_t size = 0;
 
-        byte_ostream(std::vector<byte>& data_vec) :
-            data_vec(data_vec)
+        byte_ostream(span<byte> data_span) :
+            data_span{data_span}
         {}
 
 
         void
         write(byte b)
         {
-            data_vec.push_back(b);
+            if (size >= data_span.size())
+                throw std::out_of_range{"write() size="
+                                        + to_string(size)};
+            data_span[size++] = b;
         }
 
 
@@ -241,8 +250,13 @@ namespace bps {
         void
         write(span<const byte> blob)
         {
-            for (auto b : blob)
-                write(b);
+            if (size + blob.size() > data_span.size())
+                throw std::out_of_range{"write("
+                                        + to_string(blob.size())
+                                        + ") size="
+                                        + to_string(size)};
+            std::memcpy(data_span.data() + size, blob.data(), blob.size());
+            size += blob.size();
         }
 
     };
@@ -250,9 +264,9 @@ namespace bps {
 
     struct byte_stream : byte_ostream, byte_istream {
 
-        byte_stream(std::vector<byte>& data_vec) :
-            byte_ostream{data_vec},
-            byte_istream{data_vec}
+        byte_stream(span<byte> data_span) :
+            byte_ostream{data_span},
+            byte_istream{data_span.first(0)}
         {}
 
 
@@ -260,7 +274,7 @@ namespace bps {
         write(byte b)
         {
             byte_ostream::write(b);
-            data_span = data_vec;
+            byte_istream::data_span = byte_ostream::data_span.first(size);
         }
 
 
@@ -275,7 +289,7 @@ namespace bps {
         write(span<const byte> blob)
         {
             byte_ostream::write(blob);
-            data_span = data_vec;
+            byte_istream::data_span = byte_ostream::data_span.first(size);
         }
 
     };
@@ -330,9 +344,9 @@ namespace bps {
     };
 
 
-    std::vector<byte>
-    apply(span<const byte> patch,
-          span<const byte> input)
+    info
+    check_inputs(span<const byte> patch,
+                 span<const byte> input)
     {
         info pinfo = get_info(patch);
 
@@ -348,8 +362,19 @@ namespace bps {
         if (input_crc != pinfo.crc_in)
             throw error{"bad input: CRC32 mismatch"};
 
-        std::vector<byte> output;
-        output.reserve(pinfo.size_out);
+        return pinfo;
+    }
+
+
+    void
+    apply(span<const byte> patch,
+          span<const byte> input,
+          span<byte> output)
+    {
+        info pinfo = check_inputs(patch, input);
+
+        if (output.size() != pinfo.size_out)
+            throw error{"bad output: size mismatch"};
 
         // Note: BPS patch is allowed to use 2 of the the CRC32s at the end, as extra
         // usable data
@@ -373,7 +398,7 @@ namespace bps {
 
             case action::source_read:
                 try {
-                    auto pos = output.size();
+                    auto pos = target_stream.size;
                     target_stream.write(source_stream.read_from(pos, length));
                 }
                 catch (std::exception& e) {
@@ -382,7 +407,7 @@ namespace bps {
                                 + ", action=SourceRead"
                                 + ", length=" + to_string(length)
                                 + ", source.pos=" + to_string(source_stream.pos)
-                                + ", target.size=" + to_string(target_stream.data_vec.size())
+                                + ", target.size=" + to_string(target_stream.size)
                                 + ", what=" + std::string(e.what())};
                 }
                 break;
@@ -396,7 +421,7 @@ namespace bps {
                                 + ", idx=" + to_string(act_idx)
                                 + ", action=TargetRead"
                                 + ", length=" + to_string(length)
-                                + ", target.size=" + to_string(target_stream.data_vec.size())
+                                + ", target.size=" + to_string(target_stream.size)
                                 + ", what=" + std::string(e.what())};
                 }
                 break;
@@ -421,7 +446,7 @@ namespace bps {
                                 + ", length=" + to_string(length)
                                 + ", source.pos=" + to_string(source_stream.pos)
                                 + ", rel=" + to_string(rel)
-                                + ", target.size=" + to_string(target_stream.data_vec.size())
+                                + ", target.size=" + to_string(target_stream.size)
                                 + ", what=" + std::string(e.what())};
                 }
                 break;
@@ -449,7 +474,7 @@ namespace bps {
                                 + ", length=" + to_string(length)
                                 + ", target.pos=" + to_string(target_stream.pos)
                                 + ", rel=" + to_string(rel)
-                                + ", target.size=" + to_string(target_stream.data_vec.size())
+                                + ", target.size=" + to_string(target_stream.size)
                                 + ", what=" + std::string(e.what())};
                 }
                 break;
@@ -460,14 +485,536 @@ namespace bps {
         }
 
 
-        if (output.size() != pinfo.size_out)
+        if (target_stream.size != pinfo.size_out)
             throw error{"broken BPS: output size mismatch"};
 
         uint32_t output_crc = calc_crc32(output);
         if (output_crc != pinfo.crc_out)
             throw error{"input mismatch"};
+    }
+
 
+    std::vector<byte>
+    apply(span<const byte> patch,
+          span<const byte> input)
+    {
+        std::vector<byte> output(get_info(patch).size_out);
+        apply(patch, input, output);
         return output;
     }
 
+
+    const char* action_names[] = {
+        "SourceRead",
+        "TargetRead",
+        "SourceCopy",
+        "TargetCopy",
+    };
+
+
+    // One action, with everything resolved to absolute offsets.
+    struct command {
+        uint32_t out_pos;
+        uint32_t length;
+        uint32_t from;          // offset in the input, the patch or the output
+        action act;
+    };
+
+
+    /*
+     * Decodes every action, checking that it stays inside its buffers. After this, the
+     * actions can be executed in any order that respects the TargetCopy dependencies.
+     */
+    std::vector<command>
+    scan(span<const byte> patch,
+         const info& pinfo)
+    {
+        // Same limits as apply().
+        const uintmax_t data_end = patch.size() - 4;
+        const uintmax_t patch_data_end = patch.size() - 12;
+
+        byte_istream patch_stream{patch.first(data_end)};
+        patch_stream.seek(pinfo.data_start);
+
+        std::vector<command> result;
+        uintmax_t out_pos = 0;
+        uintmax_t source_pos = 0;
+        uintmax_t target_pos = 0;
+
+        while (patch_stream.pos < patch_data_end) {
+            const auto act_idx = result.size();
+            const auto instr = patch_stream.read_varint();
+            const action act = static_cast<action>(instr & 3);
+            const uintmax_t length = (instr >> 2) + 1;
+
+            auto fail = [&](const char* what)
+            {
+                return error{"patch.pos=" + to_string(patch_stream.pos - pinfo.data_start)
+                             + ", idx=" + to_string(act_idx)
+                             + ", action=" + action_names[act]
+                             + ", length=" + to_string(length)
+                             + ", target.size=" + to_string(out_pos)
+                             + ", what=" + what};
+            };
+
+            auto read_delta = [&patch_stream](uintmax_t& pos) -> bool
+            {
+                auto delta = patch_stream.read_varint();
+                if (delta & 1) {
+                    if ((delta >> 1) > pos)
+                        return false;
+                    pos -= delta >> 1;
+                } else
+                    pos += delta >> 1;
+                return true;
+            };
+
+            if (length > pinfo.size_out - out_pos)
+                throw fail("writing past the end of the output");
+
+            command cmd{static_cast<uint32_t>(out_pos),
+                        static_cast<uint32_t>(length),
+                        0,
+                        act};
+
+            switch (act) {
+
+            case action::source_read:
+                if (out_pos + length > pinfo.size_in)
+                    throw fail("reading past the end of the source");
+                cmd.from = out_pos;
+                break;
+
+            case action::target_read:
+                if (length > data_end - patch_stream.pos)
+                    throw fail("reading past the end of the patch");
+                cmd.from = patch_stream.pos;
+                patch_stream.advance(length);
+                break;
+
+            case action::source_copy:
+                if (!read_delta(source_pos))
+                    throw fail("seeking to negative offset");
+                if (source_pos > pinfo.size_in || length > pinfo.size_in - source_pos)
+                    throw fail("reading past the end of the source");
+                cmd.from = source_pos;
+                source_pos += length;
+                break;
+
+            case action::target_copy:
+                if (!read_delta(target_pos))
+                    throw fail("seeking to negative offset");
+                // Every byte read must have been written already.
+                if (target_pos >= out_pos)
+                    throw fail("reading past the end of the output");
+                cmd.from = target_pos;
+                target_pos += length;
+                break;
+
+            } // switch (act)
+
+            result.push_back(cmd);
+            out_pos += length;
+        }
+
+        if (out_pos != pinfo.size_out)
+            throw error{"broken BPS: output size mismatch"};
+
+        return result;
+    }
+
+
+    // Executes the commands in [first, last), and tracks which ranges are complete.
+    class executor {
+
+        span<const byte> patch;
+        span<const byte> input;
+        span<byte> output;
+        const std::vector<command>& commands;
+
+        // Index of the first command of each range; the last element is commands.size().
+        std::vector<std::size_t> range_starts;
+        std::vector<uint32_t> range_offsets;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<bool> done;
+        std::size_t next_range = 0;
+
+
+        std::size_t
+        range_of(uint32_t offset)
+            const
+        {
+            auto it = std::upper_bound(range_offsets.begin(), range_offsets.end(), offset);
+            return it - range_offsets.begin() - 1;
+        }
+
+
+        // Blocks until every range that has output bytes in [first, last) is done.
+        void
+        wait_for(uint32_t first,
+                 uint32_t last)
+        {
+            const auto r1 = range_of(first);
+            const auto r2 = range_of(last - 1);
+            std::unique_lock lock{mutex};
+            cond.wait(lock, [this, r1, r2]
+            {
+                for (auto r = r1; r <= r2; ++r)
+                    if (!done[r])
+                        return false;
+                return true;
+            });
+        }
+
+
+        void
+        run_range(std::size_t r)
+        {
+            const uint32_t range_begin = range_offsets[r];
+            for (auto i = range_starts[r]; i < range_starts[r + 1]; ++i) {
+                const auto& cmd = commands[i];
+                byte* dst = output.data() + cmd.out_pos;
+                switch (cmd.act) {
+
+                case action::source_read:
+                case action::source_copy:
+                    std::memcpy(dst, input.data() + cmd.from, cmd.length);
+                    break;
+
+                case action::target_read:
+                    std::memcpy(dst, patch.data() + cmd.from, cmd.length);
+                    break;
+
+                case action::target_copy:
+                    // Only the part written by earlier ranges needs waiting for.
+                    if (cmd.from < range_begin)
+                        wait_for(cmd.from,
+                                 std::min<uint32_t>(cmd.from + cmd.length, range_begin));
+                    if (cmd.from + cmd.length <= cmd.out_pos)
+                        std::memcpy(dst, output.data() + cmd.from, cmd.length);
+                    else
+                        // Overlapping: later bytes repeat the ones just written.
+                        for (uint32_t k = 0; k < cmd.length; ++k)
+                            dst[k] = output[cmd.from + k];
+                    break;
+
+                } // switch (cmd.act)
+            }
+
+            {
+                std::lock_guard lock{mutex};
+                done[r] = true;
+            }
+            cond.notify_all();
+        }
+
+
+        void
+        worker()
+        {
+            for (;;) {
+                std::size_t r;
+                {
+                    std::lock_guard lock{mutex};
+                    if (next_range == done.size())
+                        return;
+                    r = next_range++;
+                }
+                run_range(r);
+            }
+        }
+
+    public:
+
+        executor(span<const byte> patch,
+                 span<const byte> input,
+                 span<byte> output,
+                 const std::vector<command>& commands,
+                 std::size_t range_size) :
+            patch{patch},
+            input{input},
+            output{output},
+            commands{commands}
+        {
+            uint32_t size = 0;
+            for (std::size_t i = 0; i < commands.size(); ++i) {
+                if (i == 0 || size >= range_size) {
+                    range_starts.push_back(i);
+                    range_offsets.push_back(commands[i].out_pos);
+                    size = 0;
+                }
+                size += commands[i].length;
+            }
+            range_starts.push_back(commands.size());
+            done.resize(range_offsets.size());
+        }
+
+
+        std::size_t
+        num_ranges()
+            const noexcept
+        {
+            return done.size();
+        }
+
+
+        /*
+         * Ranges are handed out in order, so a range only ever waits for ranges that were
+         * already taken by some thread; this can't deadlock.
+         */
+        void
+        run(unsigned num_threads)
+        {
+            std::vector<std::thread> threads;
+            for (unsigned t = 1; t < num_threads; ++t)
+                threads.emplace_back(&executor::worker, this);
+            worker();
+            for (auto& t : threads)
+                t.join();
+        }
+
+    };
+
+
+    void
+    apply_parallel(span<const byte> patch,
+                   span<const byte> input,
+                   span<byte> output,
+                   unsigned num_threads,
+                   std::size_t min_range_size)
+    {
+        const uintmax_t max_size = std::numeric_limits<uint32_t>::max();
+        if (num_threads < 2
+            || patch.size() > max_size
+            || input.size() > max_size
+            || output.size() > max_size)
+            return apply(patch, input, output);
+
+        info pinfo = check_inputs(patch, input);
+
+        if (output.size() != pinfo.size_out)
+            throw error{"bad output: size mismatch"};
+
+        const auto commands = scan(patch, pinfo);
+
+        // A few ranges per thread, so a slow range doesn't leave the others idle.
+        const std::size_t range_size = std::max<std::size_t>(min_range_size,
+                                                             output.size() / (4 * num_threads));
+        executor exec{patch, input, output, commands, range_size};
+        exec.run(std::min<std::size_t>(num_threads, exec.num_ranges()));
+
+        uint32_t output_crc = calc_crc32(output);
+        if (output_crc != pinfo.crc_out)
+            throw error{"input mismatch"};
+    }
+
+
+    std::vector<byte>
+    apply_parallel(span<const byte> patch,
+                   span<const byte> input,
+                   unsigned num_threads)
+    {
+        std::vector<byte> output(get_info(patch).size_out);
+        apply_parallel(patch, input, output, num_threads);
+        return output;
+    }
+
+
+    // A half-open range of offsets.
+    struct interval {
+        uint32_t first;
+        uint32_t last;
+    };
+
+
+    // The intervals must be sorted and disjoint.
+    std::vector<interval>::const_iterator
+    first_after(const std::vector<interval>& intervals,
+                uint32_t offset)
+    {
+        return std::upper_bound(intervals.begin(), intervals.end(), offset,
+                                [](uint32_t val, const interval& i)
+                                {
+                                    return val < i.last;
+                                });
+    }
+
+
+    // Extends the last interval if they touch.
+    void
+    append(std::vector<interval>& intervals,
+           uint32_t first,
+           uint32_t last)
+    {
+        if (!intervals.empty() && intervals.back().last >= first)
+            intervals.back().last = std::max(intervals.back().last, last);
+        else
+            intervals.push_back({first, last});
+    }
+
+
+    in_place_result
+    apply_in_place(span<const byte> patch,
+                   std::vector<byte>& buffer,
+                   std::size_t max_side_size)
+    {
+        in_place_result result;
+
+        const uintmax_t max_size = std::numeric_limits<uint32_t>::max();
+        if (patch.size() > max_size || buffer.size() > max_size) {
+            result.reason = "too large";
+            return result;
+        }
+
+        const info pinfo = check_inputs(patch, buffer);
+        if (pinfo.size_out > max_size) {
+            result.reason = "too large";
+            return result;
+        }
+
+        const auto commands = scan(patch, pinfo);
+
+        /*
+         * The output is written from start to end, so when a command runs, everything
+         * before its output position was already written. Only SourceRead (and a
+         * SourceCopy to the same position) leaves the source bytes as they were; any other
+         * command makes its range "dirty". A SourceCopy that reads dirty bytes needs them
+         * saved before anything is written.
+         */
+        std::vector<interval> dirty;
+        std::vector<interval> saved;
+        std::vector<bool> uses_side(commands.size());
+        for (std::size_t i = 0; i < commands.size(); ++i) {
+            const auto& cmd = commands[i];
+            bool keeps_source = cmd.act == action::source_read;
+            if (cmd.act == action::source_copy) {
+                const uint32_t last = cmd.from + cmd.length;
+                for (auto it = first_after(dirty, cmd.from);
+                     it != dirty.end() && it->first < last;
+                     ++it) {
+                    saved.push_back({std::max(cmd.from, it->first), std::min(last, it->last)});
+                    uses_side[i] = true;
+                }
+                keeps_source = cmd.from == cmd.out_pos;
+            }
+            if (!keeps_source)
+                append(dirty, cmd.out_pos, cmd.out_pos + cmd.length);
+        }
+
+        std::ranges::sort(saved, {}, &interval::first);
+        std::vector<interval> side_ranges;
+        for (const auto& r : saved)
+            append(side_ranges, r.first, r.last);
+        for (const auto& r : side_ranges)
+            result.side_size += r.last - r.first;
+
+        if (result.side_size > max_side_size) {
+            result.reason = "needs " + to_string(result.side_size) + " bytes of side buffer";
+            return result;
+        }
+
+        // Save the source ranges before the buffer is touched.
+        std::vector<byte> side(result.side_size);
+        std::vector<uint32_t> side_offsets;
+        {
+            uint32_t offset = 0;
+            for (const auto& r : side_ranges) {
+                side_offsets.push_back(offset);
+                std::memcpy(side.data() + offset, buffer.data() + r.first, r.last - r.first);
+                offset += r.last - r.first;
+            }
+        }
+
+        /*
+         * A SourceCopy that reads saved bytes is split into pieces, each one read either
+         * from the side buffer or from the buffer itself. Like memmove(), the pieces are
+         * copied back to front when moving data forward, so no piece overwrites a piece
+         * not copied yet.
+         */
+        struct piece {
+            uint32_t from;
+            uint32_t length;
+            const byte* side_data;  // null when reading from the buffer
+        };
+        std::vector<piece> pieces;
+        auto split = [&](const command& cmd)
+        {
+            pieces.clear();
+            uint32_t pos = cmd.from;
+            const uint32_t last = cmd.from + cmd.length;
+            for (auto it = first_after(side_ranges, pos);
+                 it != side_ranges.end() && it->first < last;
+                 ++it) {
+                if (pos < it->first) {
+                    pieces.push_back({pos, it->first - pos, nullptr});
+                    pos = it->first;
+                }
+                const uint32_t end = std::min(last, it->last);
+                const auto idx = it - side_ranges.begin();
+                pieces.push_back({pos,
+                                  end - pos,
+                                  side.data() + side_offsets[idx] + (pos - it->first)});
+                pos = end;
+            }
+            if (pos < last)
+                pieces.push_back({pos, last - pos, nullptr});
+            if (cmd.out_pos > cmd.from)
+                std::ranges::reverse(pieces);
+        };
+
+        if (pinfo.size_out > buffer.size())
+            buffer.resize(pinfo.size_out);
+
+        byte* const data = buffer.data();
+        for (std::size_t i = 0; i < commands.size(); ++i) {
+            const auto& cmd = commands[i];
+            byte* dst = data + cmd.out_pos;
+            switch (cmd.act) {
+
+            case action::source_read:
+                // Already in place.
+                break;
+
+            case action::target_read:
+                std::memcpy(dst, patch.data() + cmd.from, cmd.length);
+                break;
+
+            case action::source_copy:
+                if (uses_side[i]) {
+                    split(cmd);
+                    for (const auto& p : pieces) {
+                        byte* p_dst = dst + (p.from - cmd.from);
+                        if (p.side_data)
+                            std::memcpy(p_dst, p.side_data, p.length);
+                        else
+                            std::memmove(p_dst, data + p.from, p.length);
+                    }
+                } else
+                    std::memmove(dst, data + cmd.from, cmd.length);
+                break;
+
+            case action::target_copy:
+                if (cmd.from + cmd.length <= cmd.out_pos)
+                    std::memcpy(dst, data + cmd.from, cmd.length);
+                else
+                    for (uint32_t k = 0; k < cmd.length; ++k)
+                        dst[k] = data[cmd.from + k];
+                break;
+
+            } // switch (cmd.act)
+        }
+
+        buffer.resize(pinfo.size_out);
+        result.applied = true;
+
+        uint32_t output_crc = calc_crc32(buffer);
+        if (output_crc != pinfo.crc_out)
+            throw error{"input mismatch"};
+
+        return result;
+    }
+
+
 } // namespace bps
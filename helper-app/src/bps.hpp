@@ -42,11 +42,62 @@ namespace bps {
     info get_info(std::span<const std::byte> patch);
 
 
+    // The output must have exactly info::size_out bytes.
+    void
+    apply(std::span<const std::byte> patch,
+          std::span<const std::byte> input,
+          std::span<std::byte> output);
+
+
     std::vector<std::byte>
     apply(std::span<const std::byte> patch,
           std::span<const std::byte> input);
 
 
+    inline constexpr std::size_t default_min_range_size = 64 * 1024;
+
+
+    /*
+     * Same result as apply(), but the output is split into ranges that are filled in by
+     * several threads. A range that copies from earlier output (TargetCopy) waits until
+     * the ranges it reads from are done. Ranges are never smaller than min_range_size;
+     * only the tests need to change it.
+     */
+    void
+    apply_parallel(std::span<const std::byte> patch,
+                   std::span<const std::byte> input,
+                   std::span<std::byte> output,
+                   unsigned num_threads,
+                   std::size_t min_range_size = default_min_range_size);
+
+
+    std::vector<std::byte>
+    apply_parallel(std::span<const std::byte> patch,
+                   std::span<const std::byte> input,
+                   unsigned num_threads);
+
+
+    struct in_place_result {
+        bool applied = false;
+        std::size_t side_size = 0;  // source bytes that had to be saved before being overwritten
+        std::string reason{};       // why it was not applied
+    };
+
+
+    /*
+     * Applies the patch over the input buffer, which becomes the output (resized to
+     * info::size_out). Source bytes that are read after being overwritten are saved
+     * beforehand in a side buffer; if that would need more than max_side_size bytes, the
+     * buffer is left untouched, and the result says why. Growing the buffer only saves
+     * memory if its capacity is already large enough.
+     *
+     * If the output CRC32 is wrong an error is thrown, and the buffer is lost.
+     */
+    in_place_result
+    apply_in_place(std::span<const std::byte> patch,
+                   std::vector<std::byte>& buffer,
+                   std::size_t max_side_size);
+
 } // namespace bps
 
 #endif
@@ -0,0 +1,293 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <algorithm>            // min()
+#include <atomic>
+#include <chrono>
+#include <cstdio>               // remove()
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "cafe_fonts.hpp"
+#include "crc32.hpp"
+#include "timing.hpp"
+
+
+using std::cout;
+using std::endl;
+using std::filesystem::path;
+using std::uint32_t;
+
+
+namespace cafe_fonts {
+
+    const std::array<source, 4> sources = {{
+            { "CafeCn.ttf",  0X14c7272fu },
+            { "CafeKr.ttf",  0Xa2a1a55au },
+            { "CafeStd.ttf", 0Xf1252709u },
+            { "CafeTw.ttf",  0Xe5a938cdu },
+        }};
+
+
+    namespace {
+
+        const path base_path = "storage_mlc:/sys/title/0005001b/10042400/content";
+
+        const std::size_t chunk_size = 256 * 1024;
+
+
+        struct load_result {
+            blob_t content;
+            uint32_t crc = 0;
+            std::chrono::milliseconds time{};
+            std::string error;
+        };
+
+
+        /*
+         * Same as reading the whole file, but the CRC32 is calculated on another thread,
+         * as each chunk arrives.
+         */
+        blob_t
+        load_file_crc32(const path& file_path,
+                        std::size_t capacity,
+                        uint32_t& crc)
+        {
+            std::uintmax_t size = file_size(file_path);
+
+            std::filebuf fb;
+            if (!fb.open(file_path, std::ios::in | std::ios::binary))
+                throw std::runtime_error{"unable to open for reading"};
+
+            timing::clock::duration read_time{};
+            timing::clock::duration hash_time{};
+
+            blob_t result;
+            result.reserve(std::max<std::uintmax_t>(size, capacity));
+            result.resize(size);
+            crc = 0;
+
+            // How much was read so far; the maximum value means the read failed.
+            const std::size_t read_failed = std::numeric_limits<std::size_t>::max();
+            std::atomic_size_t read_end = 0;
+            std::thread hasher{[&]
+            {
+                for (std::size_t offset = 0; offset < size;) {
+                    read_end.wait(offset, std::memory_order_acquire);
+                    const std::size_t end = read_end.load(std::memory_order_acquire);
+                    if (end == read_failed)
+                        return;
+                    auto t0 = timing::clock::now();
+                    crc = calc_crc32(std::span{result.data() + offset, end - offset}, crc);
+                    hash_time += timing::clock::now() - t0;
+                    offset = end;
+                }
+            }};
+
+            for (std::size_t offset = 0; offset < size;) {
+                std::span<std::byte> chunk{result.data() + offset,
+                                           std::min<std::size_t>(chunk_size, size - offset)};
+                auto t0 = timing::clock::now();
+                auto read = fb.sgetn(reinterpret_cast<char*>(chunk.data()), chunk.size());
+                auto t1 = timing::clock::now();
+                if (read <= 0) {
+                    read_end.store(read_failed, std::memory_order_release);
+                    read_end.notify_one();
+                    hasher.join();
+                    throw std::runtime_error{"error reading file"};
+                }
+                read_time += t1 - t0;
+                offset += read;
+                read_end.store(offset, std::memory_order_release);
+                read_end.notify_one();
+            }
+            hasher.join();
+
+            const auto name = file_path.filename().string();
+            timing::add(name, timing::phase::load, read_time, size);
+            timing::add(name, timing::phase::hash, hash_time, size);
+
+            return result;
+        }
+
+
+        void
+        load_source(const path& font_path,
+                    std::size_t capacity,
+                    load_result& result)
+        {
+            auto start = std::chrono::steady_clock::now();
+            try {
+                result.content = load_file_crc32(font_path, capacity, result.crc);
+            }
+            catch (std::exception& e) {
+                result.error = e.what();
+            }
+            auto finish = std::chrono::steady_clock::now();
+            result.time = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start);
+        }
+
+    } // namespace
+
+
+    const source*
+    find(uint32_t crc)
+        noexcept
+    {
+        for (const auto& src : sources)
+            if (src.ref_crc == crc)
+                return &src;
+        return nullptr;
+    }
+
+
+    path
+    get_path(const source& src)
+    {
+        return base_path / src.name;
+    }
+
+
+    void
+    registry::load(const std::vector<const source*>& wanted,
+                   std::size_t capacity)
+    {
+        std::vector<const source*> missing;
+        for (auto src : wanted)
+            if (!loaded.contains(src->ref_crc)
+                && std::ranges::find(missing, src) == missing.end())
+                missing.push_back(src);
+        if (missing.empty())
+            return;
+
+        // One at a time, so only one source's worth of memory is being filled.
+        const auto start = std::chrono::steady_clock::now();
+        std::size_t total_size = 0;
+        for (auto src : missing) {
+            load_result result;
+            load_source(get_path(*src), capacity, result);
+            if (!result.error.empty()) {
+                cout << "Error with \"" << src->name << "\":\n"
+                     << result.error
+                     << endl;
+                continue;
+            }
+            // No patch can apply to a different version of the font.
+            const bool crc_ok = result.crc == src->ref_crc;
+            cout << "Loaded "
+                 << std::setw(7) << src->name
+                 << " (" << (crc_ok ? "OK" : "wrong crc32, not used") << ", "
+                 << result.time.count() << " ms)"
+                 << endl;
+            total_size += result.content.size();
+            if (crc_ok)
+                loaded[src->ref_crc] = std::move(result.content);
+        }
+        const auto finish = std::chrono::steady_clock::now();
+        const auto total =
+            std::chrono::duration_cast<std::chrono::milliseconds>(finish - start);
+        cout << "Loaded " << (total_size / 1024) << " KiB in " << total.count() << " ms";
+        if (total.count())
+            cout << " (" << (total_size / 1024 * 1000 / total.count()) << " KiB/s)";
+        cout << endl;
+    }
+
+
+    const blob_t*
+    registry::get(uint32_t ref_crc)
+        const noexcept
+    {
+        auto it = loaded.find(ref_crc);
+        if (it == loaded.end())
+            return nullptr;
+        return &it->second;
+    }
+
+
+    void
+    registry::release(uint32_t ref_crc)
+        noexcept
+    {
+        loaded.erase(ref_crc);
+    }
+
+
+    blob_t
+    registry::take(uint32_t ref_crc)
+        noexcept
+    {
+        auto node = loaded.extract(ref_crc);
+        if (!node)
+            return {};
+        return std::move(node.mapped());
+    }
+
+
+    uint32_t
+    export_to(const source& src, const path& dest)
+    {
+        std::filebuf in;
+        if (!in.open(get_path(src), std::ios::in | std::ios::binary))
+            throw std::runtime_error{"unable to open for reading"};
+
+        std::filebuf out;
+        if (!out.open(dest, std::ios::out | std::ios::binary))
+            throw std::runtime_error{"unable to open for writing"};
+
+        timing::clock::duration read_time{};
+        timing::clock::duration hash_time{};
+        timing::clock::duration write_time{};
+        std::uintmax_t size = 0;
+
+        try {
+            blob_t buf(chunk_size);
+            uint32_t crc = 0;
+            for (;;) {
+                auto t0 = timing::clock::now();
+                auto read = in.sgetn(reinterpret_cast<char*>(buf.data()), buf.size());
+                auto t1 = timing::clock::now();
+                if (read < 0)
+                    throw std::runtime_error{"error reading file"};
+                if (read == 0)
+                    break;
+                std::span chunk{buf.data(), static_cast<std::size_t>(read)};
+                crc = calc_crc32(chunk, crc);
+                auto t2 = timing::clock::now();
+                if (out.sputn(reinterpret_cast<const char*>(chunk.data()), read) != read)
+                    throw std::runtime_error{"unable to write all data"};
+                auto t3 = timing::clock::now();
+                read_time  += t1 - t0;
+                hash_time  += t2 - t1;
+                write_time += t3 - t2;
+                size += read;
+            }
+            auto t0 = timing::clock::now();
+            if (!out.close())
+                throw std::runtime_error{"error writing file"};
+            write_time += timing::clock::now() - t0;
+
+            timing::add(src.name, timing::phase::load, read_time,  size);
+            timing::add(src.name, timing::phase::hash, hash_time,  size);
+            timing::add(src.name, timing::phase::save, write_time, size);
+            return crc;
+        }
+        catch (...) {
+            // Don't leave a truncated font behind.
+            out.close();
+            std::remove(dest.c_str());
+            throw;
+        }
+    }
+
+} // namespace cafe_fonts
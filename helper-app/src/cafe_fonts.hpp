@@ -0,0 +1,78 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CAFE_FONTS_HPP
+#define CAFE_FONTS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <vector>
+
+
+using blob_t = std::vector<std::byte>;
+
+
+// The system fonts, as found on the MLC.
+
+namespace cafe_fonts {
+
+    struct source {
+        const char* name;
+        std::uint32_t ref_crc;
+    };
+
+
+    extern const std::array<source, 4> sources;
+
+
+    // Returns null if no system font has this CRC32.
+    const source* find(std::uint32_t crc) noexcept;
+
+
+    std::filesystem::path get_path(const source& src);
+
+
+    /*
+     * Sources are only loaded when asked for, and only kept until released. A source
+     * whose content doesn't match its reference CRC32 is not kept: patches are matched to
+     * the sources by the reference CRC32, so none of them could apply to it.
+     */
+    class registry {
+
+        std::map<std::uint32_t, blob_t> loaded;
+
+    public:
+
+        /*
+         * Loads the missing sources one after another, each one hashed while it's read,
+         * printing the time each one took. The buffers get at least the given capacity,
+         * so they can grow without moving.
+         */
+        void load(const std::vector<const source*>& wanted,
+                  std::size_t capacity = 0);
+
+        // Returns null if the source is not loaded.
+        const blob_t* get(std::uint32_t ref_crc) const noexcept;
+
+        void release(std::uint32_t ref_crc) noexcept;
+
+        // Moves the source out of the registry; empty if it's not loaded.
+        blob_t take(std::uint32_t ref_crc) noexcept;
+
+    };
+
+
+    // Copies the font in chunks, without holding all of it in memory; returns the CRC32.
+    std::uint32_t export_to(const source& src, const std::filesystem::path& dest);
+
+} // namespace cafe_fonts
+
+#endif
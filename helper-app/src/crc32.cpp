@@ -13,8 +13,10 @@
 
 
 using std::uint32_t;
+using std::uint8_t;
 
-using crc32_table_t = std::array<uint32_t, 256>;
+// Slicing-by-8: table[k] advances the CRC over a byte followed by k zero bytes.
+using crc32_table_t = std::array<std::array<uint32_t, 256>, 8>;
 
 
 namespace {
@@ -23,7 +25,7 @@ namespace {
     make_crc32_table()
     {
         crc32_table_t table;
-        for (auto [idx, elem] : std::views::enumerate(table)) {
+        for (auto [idx, elem] : std::views::enumerate(table[0])) {
             uint32_t c = idx;
             for (unsigned k = 0; k < 8; ++k)
                 if (c & 1)
@@ -32,6 +34,9 @@ namespace {
                     c >>= 1;
             elem = c;
         }
+        for (unsigned k = 1; k < table.size(); ++k)
+            for (unsigned i = 0; i < 256; ++i)
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
         return table;
     }
 
@@ -46,9 +51,30 @@ calc_crc32(std::span<const std::byte> data,
 
     crc32 = ~crc32;
 
-    for (auto b : data)
-        crc32 = table[(crc32 ^ std::to_integer<std::uint8_t>(b)) & 0xff]
-                ^ (crc32 >> 8);
+    auto byte_at = [&data](std::size_t i) -> uint8_t
+    {
+        return std::to_integer<uint8_t>(data[i]);
+    };
+
+    // Note: bytes are combined explicitly, so this works the same on any endianness.
+    std::size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        const uint32_t a = crc32 ^ (uint32_t{byte_at(i)}
+                                    | uint32_t{byte_at(i + 1)} << 8
+                                    | uint32_t{byte_at(i + 2)} << 16
+                                    | uint32_t{byte_at(i + 3)} << 24);
+        crc32 = table[7][a & 0xff]
+              ^ table[6][(a >> 8) & 0xff]
+              ^ table[5][(a >> 16) & 0xff]
+              ^ table[4][a >> 24]
+              ^ table[3][byte_at(i + 4)]
+              ^ table[2][byte_at(i + 5)]
+              ^ table[1][byte_at(i + 6)]
+              ^ table[0][byte_at(i + 7)];
+    }
+
+    for (; i < data.size(); ++i)
+        crc32 = table[0][(crc32 ^ byte_at(i)) & 0xff] ^ (crc32 >> 8);
 
     return ~crc32;
 }
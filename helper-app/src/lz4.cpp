@@ -0,0 +1,302 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Implements the LZ4 block format, as described in lz4_Block_format.md from the LZ4
+// project.
+
+#include <algorithm>            // min()
+#include <cstring>              // memcmp(), memcpy()
+
+#include "crc32.hpp"
+#include "lz4.hpp"
+
+
+using std::byte;
+using std::size_t;
+using std::span;
+using std::uint32_t;
+using std::uint8_t;
+
+using namespace std::literals;
+
+
+namespace lz4 {
+
+    error::error(const char* msg) :
+        std::runtime_error{"LZ4 error: "s + msg}
+    {}
+
+
+    error::error(const std::string& msg) :
+        std::runtime_error{"LZ4 error: "s + msg}
+    {}
+
+
+    namespace {
+
+        const char magic[4] = {'S', 'F', 'R', 'Z'};
+
+        const size_t min_match     = 4;
+        const size_t last_literals = 5;
+        const size_t mf_limit      = 12;
+        const size_t max_offset    = 65535;
+
+        const unsigned hash_bits = 14;
+
+
+        uint32_t
+        load32(const byte* p)
+            noexcept
+        {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            return v;
+        }
+
+
+        unsigned
+        hash(uint32_t v)
+            noexcept
+        {
+            return (v * 2654435761u) >> (32 - hash_bits);
+        }
+
+
+        void
+        write_le32(byte* p, uint32_t v)
+            noexcept
+        {
+            p[0] = byte(v);
+            p[1] = byte(v >> 8);
+            p[2] = byte(v >> 16);
+            p[3] = byte(v >> 24);
+        }
+
+
+        byte*
+        write_length(byte* out, size_t len)
+            noexcept
+        {
+            while (len >= 255) {
+                *out++ = byte{255};
+                len -= 255;
+            }
+            *out++ = byte(len);
+            return out;
+        }
+
+
+        byte*
+        write_sequence(byte* out,
+                       const byte* literals,
+                       size_t lit_len,
+                       size_t offset,
+                       size_t match_len)
+            noexcept
+        {
+            byte* token = out++;
+            uint8_t t = lit_len >= 15 ? 15 << 4 : lit_len << 4;
+            if (lit_len >= 15)
+                out = write_length(out, lit_len - 15);
+            std::memcpy(out, literals, lit_len);
+            out += lit_len;
+
+            if (match_len) {
+                *out++ = byte(offset);
+                *out++ = byte(offset >> 8);
+                size_t ml = match_len - min_match;
+                t |= ml >= 15 ? 15 : ml;
+                if (ml >= 15)
+                    out = write_length(out, ml - 15);
+            }
+
+            *token = byte{t};
+            return out;
+        }
+
+    } // namespace
+
+
+    header
+    parse_header(span<const byte> data)
+    {
+        if (data.size() < header_size)
+            throw error{"incomplete header"};
+        if (std::memcmp(data.data(), magic, 4))
+            throw error{"bad magic"};
+        header result;
+        result.raw_size   = read_le32(data.data() + 4);
+        result.raw_crc    = read_le32(data.data() + 8);
+        result.block_size = read_le32(data.data() + 12);
+        if (!result.block_size || (result.block_size & stored_flag))
+            throw error{"bad block size"};
+        return result;
+    }
+
+
+    uint32_t
+    read_le32(const byte* p)
+        noexcept
+    {
+        return uint32_t(p[0])
+            | uint32_t(p[1]) << 8
+            | uint32_t(p[2]) << 16
+            | uint32_t(p[3]) << 24;
+    }
+
+
+    size_t
+    block_bound(size_t size)
+        noexcept
+    {
+        return size + size / 255 + 16;
+    }
+
+
+    size_t
+    decompress_block(span<const byte> input,
+                     span<byte> output)
+    {
+        const byte* ip = input.data();
+        const byte* const ip_end = ip + input.size();
+        byte* const out_begin = output.data();
+        byte* op = out_begin;
+        byte* const op_end = op + output.size();
+
+        auto read_length = [&ip, ip_end](size_t len) -> size_t
+        {
+            if (len != 15)
+                return len;
+            uint8_t b;
+            do {
+                if (ip == ip_end)
+                    throw error{"truncated length"};
+                b = to_integer<uint8_t>(*ip++);
+                len += b;
+            } while (b == 255);
+            return len;
+        };
+
+        while (ip < ip_end) {
+            const uint8_t token = to_integer<uint8_t>(*ip++);
+
+            size_t lit_len = read_length(token >> 4);
+            if (lit_len > size_t(ip_end - ip))
+                throw error{"literals past end of input"};
+            if (lit_len > size_t(op_end - op))
+                throw error{"literals past end of output"};
+            std::memcpy(op, ip, lit_len);
+            ip += lit_len;
+            op += lit_len;
+
+            // The last sequence has no match.
+            if (ip == ip_end)
+                break;
+
+            if (ip_end - ip < 2)
+                throw error{"truncated offset"};
+            size_t offset = to_integer<size_t>(ip[0]) | to_integer<size_t>(ip[1]) << 8;
+            ip += 2;
+            if (!offset || offset > size_t(op - out_begin))
+                throw error{"bad match offset"};
+
+            size_t match_len = read_length(token & 15) + min_match;
+            if (match_len > size_t(op_end - op))
+                throw error{"match past end of output"};
+
+            const byte* match = op - offset;
+            if (offset >= match_len) {
+                std::memcpy(op, match, match_len);
+                op += match_len;
+            } else {
+                // Overlapping match, repeats the last offset bytes.
+                while (match_len--)
+                    *op++ = *match++;
+            }
+        }
+
+        return op - out_begin;
+    }
+
+
+    size_t
+    compress_block(span<const byte> input,
+                   span<byte> output)
+    {
+        if (output.size() < block_bound(input.size()))
+            throw error{"output buffer is too small"};
+
+        const byte* const src = input.data();
+        const size_t n = input.size();
+        byte* op = output.data();
+
+        size_t anchor = 0;
+
+        if (n > mf_limit) {
+            // Positions plus one, so zero means empty.
+            std::vector<uint32_t> table(size_t{1} << hash_bits, 0);
+
+            size_t ip = 0;
+            const size_t match_limit = n - last_literals;
+            while (ip + mf_limit <= n) {
+                const uint32_t seq = load32(src + ip);
+                const unsigned h = hash(seq);
+                const size_t ref = table[h];
+                table[h] = ip + 1;
+
+                if (ref && ip - (ref - 1) <= max_offset && load32(src + ref - 1) == seq) {
+                    const size_t match = ref - 1;
+                    size_t len = min_match;
+                    while (ip + len < match_limit && src[match + len] == src[ip + len])
+                        ++len;
+                    op = write_sequence(op, src + anchor, ip - anchor, ip - match, len);
+                    ip += len;
+                    anchor = ip;
+                } else
+                    ++ip;
+            }
+        }
+
+        op = write_sequence(op, src + anchor, n - anchor, 0, 0);
+
+        return op - output.data();
+    }
+
+
+    std::vector<byte>
+    compress(span<const byte> raw,
+             uint32_t block_size)
+    {
+        if (!block_size || (block_size & stored_flag))
+            throw error{"bad block size"};
+
+        std::vector<byte> result(header_size);
+        std::memcpy(result.data(), magic, 4);
+        write_le32(result.data() + 4,  raw.size());
+        write_le32(result.data() + 8,  calc_crc32(raw));
+        write_le32(result.data() + 12, block_size);
+
+        std::vector<byte> buf(block_bound(block_size));
+        for (size_t offset = 0; offset < raw.size(); offset += block_size) {
+            auto block = raw.subspan(offset, std::min<size_t>(block_size, raw.size() - offset));
+            size_t size = compress_block(block, buf);
+            const bool stored = size >= block.size();
+            const byte* data = stored ? block.data() : buf.data();
+            if (stored)
+                size = block.size();
+
+            auto pos = result.size();
+            result.resize(pos + 4 + size);
+            write_le32(result.data() + pos, size | (stored ? stored_flag : 0));
+            std::memcpy(result.data() + pos + 4, data, size);
+        }
+
+        return result;
+    }
+
+} // namespace lz4
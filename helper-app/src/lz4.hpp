@@ -0,0 +1,86 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LZ4_HPP
+#define LZ4_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/*
+ * Compressed font container (".ttf.lz4"):
+ *
+ *   - magic "SFRZ" (4 bytes)
+ *   - raw size (le32)
+ *   - raw CRC32 (le32)
+ *   - block size (le32): maximum uncompressed size of each block
+ *   - blocks, each one:
+ *       - size (le32); if the top bit is set, the block is stored uncompressed
+ *       - data: an independent LZ4 block
+ *
+ * Blocks are independent, so they can be decompressed as they are read.
+ */
+
+namespace lz4 {
+
+    struct error : std::runtime_error {
+
+        error(const char* msg);
+        error(const std::string& msg);
+
+    };
+
+
+    inline constexpr std::size_t header_size = 16;
+    inline constexpr std::uint32_t default_block_size = 256 * 1024;
+    inline constexpr std::uint32_t stored_flag = 0x80000000u;
+
+
+    struct header {
+        std::uint32_t raw_size;
+        std::uint32_t raw_crc;
+        std::uint32_t block_size;
+    };
+
+
+    // Throws if the magic is wrong.
+    header parse_header(std::span<const std::byte> data);
+
+
+    std::uint32_t read_le32(const std::byte* p) noexcept;
+
+
+    // Maximum compressed size of a block with this many bytes.
+    std::size_t block_bound(std::size_t size) noexcept;
+
+
+    // Returns how many bytes were written to output.
+    std::size_t
+    decompress_block(std::span<const std::byte> input,
+                     std::span<std::byte> output);
+
+
+    // Output must have at least block_bound() bytes; returns how many bytes were written.
+    std::size_t
+    compress_block(std::span<const std::byte> input,
+                   std::span<std::byte> output);
+
+
+    // Creates a whole container.
+    std::vector<std::byte>
+    compress(std::span<const std::byte> raw,
+             std::uint32_t block_size = default_block_size);
+
+} // namespace lz4
+
+#endif
@@ -6,6 +6,9 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
@@ -14,16 +17,18 @@
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <ranges>
 #include <stdexcept>
 #include <string>
 #include <thread>
-#include <variant>
 #include <vector>
 
 #include <sys/iosupport.h>
 
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
 #include <padscore/kpad.h>
 #include <sysapp/launch.h>
 #include <vpad/input.h>
@@ -34,8 +39,14 @@
 
 #include <mocha/mocha.h>
 
+#include "alloc_stats.hpp"
+#include "async_writer.hpp"
 #include "bps.hpp"
+#include "cafe_fonts.hpp"
 #include "crc32.hpp"
+#include "lz4.hpp"
+#include "timing.hpp"
+#include "woff.hpp"
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -48,16 +59,6 @@ using std::cout;
 using std::endl;
 using std::uint32_t;
 
-using blob_t = std::vector<std::byte>;
-
-
-struct font_info {
-    uint32_t ref_crc = 0;
-    std::string name;
-    blob_t content;
-};
-
-
 struct guard_base {
     bool valid = false;
 
@@ -131,6 +132,93 @@ namespace mocha {
 } // namespace mocha
 
 
+/*
+ * Assembles whole lines before they go to the log, and limits how often the console
+ * gets redrawn.
+ */
+namespace log_sink {
+
+    std::mutex mutex;
+
+    char line[256];
+    std::size_t line_size = 0;
+
+    bool dirty = false;
+    std::chrono::steady_clock::time_point last_draw;
+    unsigned draws = 0;
+    unsigned coalesced = 0;
+
+    // At most one redraw per frame.
+    const std::chrono::microseconds min_draw_interval{16'667};
+
+
+    // The mutex must be locked.
+    bool
+    send_line()
+    {
+        line[line_size] = '\0';
+        line_size = 0;
+        dirty = true;
+        return WHBLogWrite(line);
+    }
+
+
+    // The mutex must be locked.
+    void
+    draw()
+    {
+        WHBLogConsoleDraw();
+        last_draw = std::chrono::steady_clock::now();
+        dirty = false;
+        ++draws;
+    }
+
+
+    bool
+    write(const char* ptr, std::size_t len)
+    {
+        std::lock_guard guard{mutex};
+        bool ok = true;
+        for (std::size_t i = 0; i < len; ++i) {
+            line[line_size++] = ptr[i];
+            if (ptr[i] == '\n' || line_size == sizeof line - 1)
+                ok = send_line() && ok;
+        }
+        if (dirty) {
+            if (std::chrono::steady_clock::now() - last_draw >= min_draw_interval)
+                draw();
+            else
+                ++coalesced;
+        }
+        return ok;
+    }
+
+
+    // Redraws only if something changed since the last draw, or when forced.
+    void
+    draw_if_needed(bool force)
+    {
+        std::lock_guard guard{mutex};
+        if (line_size)
+            send_line();
+        if (dirty || force)
+            draw();
+    }
+
+
+    // Sends out any partial line, and redraws the console; used before long operations.
+    void
+    flush()
+    {
+        std::lock_guard guard{mutex};
+        if (line_size)
+            send_line();
+        draw();
+    }
+
+} // namespace log_sink
+
+
 namespace whb {
 
     struct log_module : guard_base {
@@ -180,7 +268,7 @@ namespace whb {
         void
         draw()
         {
-            WHBLogConsoleDraw();
+            log_sink::flush();
         }
 
     };
@@ -225,26 +313,13 @@ struct kpad {
 };
 
 
-enum class Stage {
-
-    Mounting,
-    List,
-    Wait,
-    Apply,
-
-};
-
-
 ssize_t
 write_to_log(_reent*, void*, const char* ptr, size_t len)
 {
     try {
-        // only way to guarantee it's null-terminated
-        std::string buf{ptr, len};
-        if (!WHBLogWrite(buf.c_str()))
+        if (!log_sink::write(ptr, len))
             return -1;
-        whb::console::draw();
-        return buf.size();
+        return len;
     }
     catch (...) {
         return -1;
@@ -301,125 +376,353 @@ load_file(const path& file_path)
 }
 
 
-void
-save_file(const path& file_path, const blob_t& data)
+enum class action {
+    generate,
+    export_fonts,
+    compress,
+    show_plan,
+    verify,
+    cancel,
+};
+
+
+enum controller {
+    gamepad,
+    wiimote,
+    nunchuk,
+    classic,
+    pro,
+    num_controllers
+};
+
+
+struct button_mapping {
+    std::array<uint32_t, num_controllers> buttons;
+    action act;
+};
+
+
+// Which buttons trigger each action, on each kind of controller.
+const button_mapping button_table[] = {
+    {{ VPAD_BUTTON_A,
+       WPAD_BUTTON_A,
+       0,
+       WPAD_CLASSIC_BUTTON_A,
+       WPAD_PRO_BUTTON_A },
+     action::generate },
+    {{ VPAD_BUTTON_PLUS,
+       WPAD_BUTTON_PLUS,
+       0,
+       WPAD_CLASSIC_BUTTON_PLUS,
+       WPAD_PRO_BUTTON_PLUS },
+     action::export_fonts },
+    {{ VPAD_BUTTON_Y,
+       WPAD_BUTTON_1,
+       0,
+       WPAD_CLASSIC_BUTTON_Y,
+       WPAD_PRO_BUTTON_Y },
+     action::compress },
+    {{ VPAD_BUTTON_X,
+       WPAD_BUTTON_2,
+       0,
+       WPAD_CLASSIC_BUTTON_X,
+       WPAD_PRO_BUTTON_X },
+     action::show_plan },
+    {{ VPAD_BUTTON_MINUS,
+       WPAD_BUTTON_MINUS,
+       0,
+       WPAD_CLASSIC_BUTTON_MINUS,
+       WPAD_PRO_BUTTON_MINUS },
+     action::verify },
+    {{ VPAD_BUTTON_B | VPAD_BUTTON_L | VPAD_BUTTON_R | VPAD_BUTTON_ZL | VPAD_BUTTON_ZR,
+       WPAD_BUTTON_B,
+       WPAD_NUNCHUK_BUTTON_Z | WPAD_NUNCHUK_BUTTON_C,
+       WPAD_CLASSIC_BUTTON_B | WPAD_CLASSIC_BUTTON_L | WPAD_CLASSIC_BUTTON_R |
+       WPAD_CLASSIC_BUTTON_ZL | WPAD_CLASSIC_BUTTON_ZR,
+       WPAD_PRO_BUTTON_B | WPAD_PRO_TRIGGER_L | WPAD_PRO_TRIGGER_R |
+       WPAD_PRO_TRIGGER_ZL | WPAD_PRO_TRIGGER_ZR },
+     action::cancel },
+};
+
+
+std::optional<action>
+find_action(controller ctrl,
+            uint32_t trigger)
+    noexcept
 {
-    std::filebuf fb;
-    if (!fb.open(file_path, std::ios::out | std::ios::binary))
-        throw std::runtime_error{"unable to open for writing"};
-
-    auto written = fb.sputn(reinterpret_cast<const char*>(data.data()), data.size());
-    if (written <= 0)
-        throw std::runtime_error{"error writing file"};
-    if (static_cast<blob_t::size_type>(written) != data.size())
-        throw std::runtime_error{"unable to write all data"};
+    for (const auto& mapping : button_table)
+        if (trigger & mapping.buttons[ctrl])
+            return mapping.act;
+    return {};
 }
 
 
+// The Wii Remote channels, including the ones for extra controllers.
+const unsigned num_kpad_channels = 7;
 
-using any_button_t = std::variant<VPADButtons,
-                                  WPADButton,
-                                  WPADNunchukButton,
-                                  WPADClassicButton,
-                                  WPADProButton>;
 
-any_button_t
-wait_for_action_button()
+std::optional<action>
+poll_kpad(unsigned channel)
 {
+    KPADStatus buf;
+    int r = KPADRead(static_cast<KPADChan>(channel), &buf, 1);
+    if (r != 1 || buf.error)
+        return {};
+    switch (buf.extensionType) {
+    case WPAD_EXT_NUNCHUK:
+    case WPAD_EXT_MPLUS_NUNCHUK:
+        if (auto act = find_action(nunchuk, buf.nunchuk.trigger))
+            return act;
+        break;
+    case WPAD_EXT_CLASSIC:
+    case WPAD_EXT_MPLUS_CLASSIC:
+        if (auto act = find_action(classic, buf.classic.trigger))
+            return act;
+        break;
+    case WPAD_EXT_PRO_CONTROLLER:
+        // skip processing core buttons
+        return find_action(pro, buf.pro.trigger);
+    }
+    return find_action(wiimote, buf.trigger);
+}
+
+
+// GX2 is never initialized here, so GX2WaitForVsync() can't pace the loops; sleep for
+// about one frame instead.
+void
+sleep_one_frame()
+{
+    OSSleepTicks(OSMillisecondsToTicks(16));
+}
+
+
+/*
+ * Polls the controllers once per frame, sleeping for a frame in between.
+ * The console is only redrawn when something was logged, or once per second.
+ */
+action
+wait_for_action()
+{
+    using clock = std::chrono::steady_clock;
+
+    clock::duration busy{};
+    clock::duration idle{};
+    unsigned frame = 0;
+    std::vector<unsigned> kpad_channels;
+
+    auto report = [&busy, &idle]
+    {
+        auto total = busy + idle;
+        if (total.count())
+            cout << "Input wait: "
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(busy).count()
+                 << " ms polling, "
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(idle).count()
+                 << " ms idle (" << (100 * busy / total) << "% busy)"
+                 << endl;
+    };
 
     while (whb::proc::is_running()) {
+        auto t0 = clock::now();
+
+        // Only probe for connected Wii Remotes once per second.
+        if (frame % 60 == 0) {
+            kpad_channels.clear();
+            for (unsigned channel = 0; channel < num_kpad_channels; ++channel) {
+                uint32_t type;
+                if (WPADProbe(static_cast<WPADChan>(channel), &type) == 0)
+                    kpad_channels.push_back(channel);
+            }
+        }
 
         for (auto channel : {VPAD_CHAN_0, VPAD_CHAN_1}) {
-            const auto mask = VPAD_BUTTON_A    | VPAD_BUTTON_B     |
-                              VPAD_BUTTON_X    | VPAD_BUTTON_Y     |
-                              VPAD_BUTTON_L    | VPAD_BUTTON_R     |
-                              VPAD_BUTTON_ZL   | VPAD_BUTTON_ZR    |
-                              VPAD_BUTTON_PLUS | VPAD_BUTTON_MINUS;
             VPADStatus buf;
             int r = VPADRead(channel, &buf, 1, nullptr);
             if (r != 1)
                 continue;
-            if (buf.trigger & mask)
-                return static_cast<VPADButtons>(buf.trigger & mask);
+            if (auto act = find_action(gamepad, buf.trigger)) {
+                busy += clock::now() - t0;
+                report();
+                return *act;
+            }
         }
 
-        for (int channel = 0; channel < 7; ++channel) {
-            KPADStatus buf;
-            int r = KPADRead(static_cast<KPADChan>(channel), &buf, 1);
-            if (r != 1)
-                continue;
-            if (buf.error)
-                continue;
-            switch (buf.extensionType) {
-            case WPAD_EXT_NUNCHUK:
-            case WPAD_EXT_MPLUS_NUNCHUK:
-                {
-                    const auto mask = WPAD_NUNCHUK_BUTTON_Z | WPAD_NUNCHUK_BUTTON_C;
-                    if (buf.nunchuk.trigger & mask)
-                        return static_cast<WPADNunchukButton>(buf.nunchuk.trigger & mask);
-                }
-                break;
-            case WPAD_EXT_CLASSIC:
-            case WPAD_EXT_MPLUS_CLASSIC:
-                {
-                    const auto mask = WPAD_CLASSIC_BUTTON_A    | WPAD_CLASSIC_BUTTON_B     |
-                                      WPAD_CLASSIC_BUTTON_X    | WPAD_CLASSIC_BUTTON_Y     |
-                                      WPAD_CLASSIC_BUTTON_L    | WPAD_CLASSIC_BUTTON_R     |
-                                      WPAD_CLASSIC_BUTTON_ZL   | WPAD_CLASSIC_BUTTON_ZR    |
-                                      WPAD_CLASSIC_BUTTON_PLUS | WPAD_CLASSIC_BUTTON_MINUS;
-                    if (buf.classic.trigger & mask)
-                        return static_cast<WPADClassicButton>(buf.classic.trigger & mask);
-                }
-                break;
-            case WPAD_EXT_PRO_CONTROLLER:
-                {
-                    const auto mask = WPAD_PRO_BUTTON_A    | WPAD_PRO_BUTTON_B     |
-                                      WPAD_PRO_BUTTON_X    | WPAD_PRO_BUTTON_Y     |
-                                      WPAD_PRO_TRIGGER_L   | WPAD_PRO_TRIGGER_R    |
-                                      WPAD_PRO_TRIGGER_ZL  | WPAD_PRO_TRIGGER_ZR   |
-                                      WPAD_PRO_BUTTON_PLUS | WPAD_PRO_BUTTON_MINUS;
-                    if (buf.pro.trigger & mask)
-                        return static_cast<WPADProButton>(buf.pro.trigger & mask);
-                }
-                continue; // skip processing core buttons
+        for (auto channel : kpad_channels)
+            if (auto act = poll_kpad(channel)) {
+                busy += clock::now() - t0;
+                report();
+                return *act;
             }
 
-            const auto mask = WPAD_BUTTON_A    | WPAD_BUTTON_B     |
-                              WPAD_BUTTON_1    | WPAD_BUTTON_2     |
-                              WPAD_BUTTON_PLUS | WPAD_BUTTON_MINUS;
-            if (buf.trigger & mask)
-                return static_cast<WPADButton>(buf.trigger & mask);
-        }
+        log_sink::draw_if_needed(frame % 60 == 0);
+        ++frame;
 
-        whb::console::draw();
+        auto t1 = clock::now();
+        sleep_one_frame();
+        auto t2 = clock::now();
+        busy += t1 - t0;
+        idle += t2 - t1;
     }
     throw whb::proc::quit{};
 }
 
 
-blob_t
-apply_patch(const blob_t& bps_patch,
-            const std::map<uint32_t, font_info>& sources)
+// Keeps the console up, without spinning, until the user closes the app.
+void
+wait_for_exit()
 {
-    blob_t result;
+    for (unsigned frame = 0; whb::proc::is_running(); ++frame) {
+        log_sink::draw_if_needed(frame % 60 == 0);
+        sleep_one_frame();
+    }
+}
 
-    auto info = bps::get_info(bps_patch);
 
-    auto src_iter = sources.find(info.crc_in);
-    if (src_iter == sources.end())
-        throw std::runtime_error{"BPS patch in_crc does not match any source."};
+// Only reads the start and the end of the patch, enough for bps::get_info().
+bps::info
+read_patch_info(const path& patch_path)
+{
+    std::uintmax_t size = file_size(patch_path);
+    if (size < 4 + 3 + 12)
+        throw std::runtime_error{"patch file size is too small"};
 
-    const auto& src = src_iter->second;
+    std::filebuf fb;
+    if (!fb.open(patch_path, std::ios::in | std::ios::binary))
+        throw std::runtime_error{"unable to open for reading"};
 
-    return bps::apply(bps_patch, src.content);
+    // The header is 4 bytes of magic, followed by 3 varints of up to 10 bytes each.
+    const std::size_t head_size = std::min<std::uintmax_t>(4 + 3 * 10, size - 12);
+    blob_t buf(head_size + 12);
+    if (fb.sgetn(reinterpret_cast<char*>(buf.data()), head_size)
+        != static_cast<std::streamsize>(head_size))
+        throw std::runtime_error{"unable to read patch header"};
+    if (fb.pubseekoff(size - 12, std::ios::beg) == std::streampos(std::streamoff(-1)))
+        throw std::runtime_error{"unable to seek in patch"};
+    if (fb.sgetn(reinterpret_cast<char*>(buf.data() + head_size), 12) != 12)
+        throw std::runtime_error{"unable to read patch CRC32s"};
+
+    return bps::get_info(buf);
 }
 
 
 const path sd_fonts_path = "fs:/vol/external01/wiiu/fonts";
 
 
+// The Wii U has 3 CPU cores.
+const unsigned num_cores = 3;
+
+
+void
+print_saved(const std::vector<async_writer::result>& results)
+{
+    for (const auto& res : results) {
+        if (res.error.empty()) {
+            cout << "Saved " << res.dest.filename() << endl;
+            timing::print_file(res.name);
+        } else
+            cout << "Error with " << res.dest.filename() << "\n"
+                 << res.error
+                 << endl;
+    }
+}
+
+
+// Shows the totals, and keeps a record of them in "SD:/wiiu/fonts/helper-timing.csv".
 void
-generate_custom_fonts(const std::map<uint32_t, font_info>& cafe_fonts)
+report_timing(const std::string& action)
+{
+    timing::print_summary();
+    timing::save_csv(sd_fonts_path / "helper-timing.csv", action);
+    cout << "Console: " << log_sink::draws << " draws, "
+         << log_sink::coalesced << " coalesced." << endl;
+}
+
+
+struct settings {
+    // Upper limit for the memory used while applying patches; 0 means no limit.
+    std::uintmax_t memory_limit_mib = 0;
+
+    // How much output can wait to be written to the SD card.
+    std::uintmax_t write_queue_mib = 16;
+};
+
+
+// Settings are read from "SD:/wiiu/fonts/helper.ini", as "key = value" lines.
+settings
+load_settings()
+{
+    settings result;
+    std::ifstream in{sd_fonts_path / "helper.ini"};
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#' || line[0] == ';')
+            continue;
+        auto eq = line.find('=');
+        if (eq == std::string::npos)
+            continue;
+        auto trim = [](std::string str) -> std::string
+        {
+            auto first = str.find_first_not_of(" \t\r");
+            auto last  = str.find_last_not_of(" \t\r");
+            if (first == std::string::npos)
+                return {};
+            return str.substr(first, last - first + 1);
+        };
+        auto key   = trim(line.substr(0, eq));
+        auto value = trim(line.substr(eq + 1));
+        try {
+            if (key == "memory_limit_mib")
+                result.memory_limit_mib = std::stoul(value);
+            else if (key == "write_queue_mib")
+                result.write_queue_mib = std::stoul(value);
+            else
+                cout << "Unknown setting in helper.ini: " << key << endl;
+        }
+        catch (std::exception& e) {
+            cout << "Invalid value in helper.ini for " << key << ": " << value << endl;
+        }
+    }
+    return result;
+}
+
+
+struct patch_job {
+    path patch_path;
+    path output_path;
+    std::uintmax_t patch_size;
+    bps::info info;
+
+
+    // The source, the patch and the output are in memory at the same time.
+    std::uintmax_t
+    peak_memory()
+        const noexcept
+    {
+        return info.size_in + patch_size + info.size_out;
+    }
+};
+
+
+// All the patches that apply to one system font.
+struct patch_group {
+    const cafe_fonts::source* src;
+    std::vector<patch_job> jobs;
+
+
+    std::uintmax_t
+    peak_memory()
+        const noexcept
+    {
+        std::uintmax_t result = 0;
+        for (const auto& job : jobs)
+            result = std::max(result, job.peak_memory());
+        return result;
+    }
+};
+
+
+std::vector<path>
+find_patches()
 {
     std::vector<path> patch_paths;
     for (const auto& entry : std::filesystem::directory_iterator{sd_fonts_path}) {
@@ -428,7 +731,37 @@ generate_custom_fonts(const std::map<uint32_t, font_info>& cafe_fonts)
         if (has_extension(entry, ".bps"))
             patch_paths.push_back(entry.path());
     }
-    cout << "Generating fonts..." << endl;
+    std::ranges::sort(patch_paths);
+    return patch_paths;
+}
+
+
+std::vector<path>
+find_web_fonts()
+{
+    std::vector<path> font_paths;
+    for (const auto& entry : std::filesystem::directory_iterator{sd_fonts_path}) {
+        if (!entry.is_regular_file())
+            continue;
+        if (has_extension(entry, ".woff") || has_extension(entry, ".woff2"))
+            font_paths.push_back(entry.path());
+    }
+    std::ranges::sort(font_paths);
+    return font_paths;
+}
+
+
+/*
+ * Only the start and the end of each patch is read, so the plan is cheap to make.
+ * Groups follow the order of the system fonts.
+ */
+std::vector<patch_group>
+plan_patches(const std::vector<path>& patch_paths)
+{
+    std::vector<patch_group> groups;
+    for (const auto& src : cafe_fonts::sources)
+        groups.push_back({&src, {}});
+
     for (const auto& patch_path : patch_paths) {
         try {
             path output_path = patch_path;
@@ -440,12 +773,14 @@ generate_custom_fonts(const std::map<uint32_t, font_info>& cafe_fonts)
                      << endl;
                 continue;
             }
-
-            blob_t patch = load_file(patch_path);
-            cout << "Processing " << patch_path.filename() << endl;
-            blob_t output = apply_patch(patch, cafe_fonts);
-            save_file(output_path, output);
-            cout << "Saved " << output_path.filename() << endl;
+            auto info = read_patch_info(patch_path);
+            auto src = cafe_fonts::find(info.crc_in);
+            if (!src)
+                throw std::runtime_error{"BPS patch in_crc does not match any source."};
+            groups[src - cafe_fonts::sources.data()].jobs.push_back({patch_path,
+                                                                    output_path,
+                                                                    file_size(patch_path),
+                                                                    info});
         }
         catch (std::exception& e) {
             cout << "Error with " << patch_path.filename() << "\n"
@@ -453,41 +788,468 @@ generate_custom_fonts(const std::map<uint32_t, font_info>& cafe_fonts)
                  << endl;
         }
     }
+
+    std::erase_if(groups, [](const patch_group& g) { return g.jobs.empty(); });
+    return groups;
+}
+
+
+std::uintmax_t
+to_kib(std::uintmax_t bytes)
+    noexcept
+{
+    return (bytes + 1023) / 1024;
+}
+
+
+bool
+fits(const patch_job& job,
+     const settings& cfg)
+    noexcept
+{
+    return !cfg.memory_limit_mib
+        || job.peak_memory() <= cfg.memory_limit_mib * 1024 * 1024;
+}
+
+
+void
+show_patch_plan()
+{
+    const auto cfg = load_settings();
+    const auto groups = plan_patches(find_patches());
+
+    cout << "Patch plan";
+    if (cfg.memory_limit_mib)
+        cout << " (memory limit: " << cfg.memory_limit_mib << " MiB)";
+    cout << ":" << endl;
+
+    std::uintmax_t peak = 0;
+    for (const auto& group : groups) {
+        cout << group.src->name << " (" << to_kib(group.jobs.front().info.size_in) << " KiB)"
+             << endl;
+        for (const auto& job : group.jobs) {
+            cout << "  " << job.patch_path.filename()
+                 << " -> " << to_kib(job.info.size_out) << " KiB";
+            if (fits(job, cfg))
+                peak = std::max(peak, job.peak_memory());
+            else
+                cout << " (over the limit)";
+            cout << endl;
+        }
+    }
+    if (groups.empty())
+        cout << "Nothing to do." << endl;
+    else
+        cout << "Estimated peak memory: " << to_kib(peak) << " KiB, plus up to "
+             << cfg.write_queue_mib << " MiB of pending writes" << endl;
+}
+
+
+// Web fonts don't need any system font, each one is decoded on its own.
+void
+decode_web_fonts(const std::vector<path>& font_paths,
+                 async_writer& writer)
+{
+    for (const auto& font_path : font_paths) {
+        try {
+            path output_path = font_path;
+            output_path.replace_extension(".ttf");
+            if (exists(output_path)) {
+                cout << "Skipped: "
+                     << output_path.filename()
+                     << " already exists."
+                     << endl;
+                continue;
+            }
+            if (has_extension(font_path, ".woff2") && !woff::woff2_supported()) {
+                cout << "Skipped: " << font_path.filename()
+                     << " (this build has no WOFF2 support)."
+                     << endl;
+                continue;
+            }
+
+            const auto name = font_path.filename().string();
+            cout << "Processing " << font_path.filename() << endl;
+            log_sink::flush();
+            woff::stats stats;
+            blob_t output;
+            {
+                timing::scope t{name, timing::phase::decode};
+                output = woff::decode_file(font_path, &stats);
+                t.set_bytes(output.size());
+            }
+            cout << "Decoded " << font_path.filename()
+                 << " (" << to_kib(stats.input_size) << " KiB -> "
+                 << to_kib(stats.output_size) << " KiB, "
+                 << stats.num_tables << " tables)"
+                 << endl;
+            writer.push(name, output_path, std::move(output));
+        }
+        catch (std::exception& e) {
+            cout << "Error with " << font_path.filename() << "\n"
+                 << e.what()
+                 << endl;
+        }
+        print_saved(writer.take_results());
+    }
+}
+
+
+/*
+ * The source is not needed after its last patch, so the output is built in its buffer,
+ * instead of in a new one. Falls back to a normal patch when too much of the source would
+ * have to be saved aside.
+ */
+blob_t
+apply_last(cafe_fonts::registry& sources,
+           std::uint32_t ref_crc,
+           std::span<const std::byte> patch,
+           const bps::info& info)
+{
+    blob_t buffer = sources.take(ref_crc);
+    // Only worth it if at least half of the smaller buffer is saved.
+    const std::size_t max_side = std::min(info.size_in, info.size_out) / 2;
+    const std::uintmax_t normal_peak = info.size_in + info.size_out;
+    const std::size_t capacity = buffer.capacity();
+    auto result = bps::apply_in_place(patch, buffer, max_side);
+    if (!result.applied) {
+        cout << "Not applied in place: " << result.reason << endl;
+        return bps::apply_parallel(patch, buffer, num_cores);
+    }
+    const std::uintmax_t peak = std::max<std::uintmax_t>(capacity, buffer.capacity())
+                              + result.side_size;
+    if (peak < normal_peak)
+        cout << "Applied in place: saved " << to_kib(normal_peak - peak) << " KiB"
+             << " (side buffer " << to_kib(result.side_size) << " KiB)" << endl;
+    return buffer;
+}
+
+
+/*
+ * Each system font is loaded once, used for all of its patches, and released before
+ * the next one is loaded. Web fonts are decoded first.
+ */
+void
+generate_custom_fonts(cafe_fonts::registry& sources,
+                       const std::vector<path>& patch_paths,
+                       const std::vector<path>& web_font_paths)
+{
+    const auto cfg = load_settings();
+    const auto groups = plan_patches(patch_paths);
+
+    // Outputs are saved while the next patch is applied.
+    async_writer writer{cfg.write_queue_mib * 1024 * 1024};
+
+    cout << "Generating fonts..." << endl;
+    log_sink::flush();
+    decode_web_fonts(web_font_paths, writer);
+    for (const auto& group : groups) {
+        std::vector<const patch_job*> jobs;
+        for (const auto& job : group.jobs) {
+            if (fits(job, cfg))
+                jobs.push_back(&job);
+            else
+                cout << "Skipped: " << job.patch_path.filename()
+                     << " needs " << to_kib(job.peak_memory()) << " KiB, over the limit."
+                     << endl;
+        }
+        if (jobs.empty())
+            continue;
+
+        // The last patch is applied over the source itself, so reserve room for its output.
+        sources.load({group.src}, jobs.back()->info.size_out);
+        auto source = sources.get(group.src->ref_crc);
+
+        for (auto job : jobs) {
+            try {
+                if (!source)
+                    throw std::runtime_error{"could not load "s + group.src->name};
+
+                const auto name = job->patch_path.filename().string();
+                blob_t patch;
+                {
+                    timing::scope t{name, timing::phase::load, job->patch_size};
+                    patch = load_file(job->patch_path);
+                }
+                cout << "Processing " << job->patch_path.filename() << endl;
+                log_sink::flush();
+                blob_t output;
+                {
+                    timing::scope t{name, timing::phase::apply, job->info.size_out};
+                    if (job == jobs.back())
+                        output = apply_last(sources, group.src->ref_crc, patch, job->info);
+                    else
+                        // Large patches are split across all cores.
+                        output = bps::apply_parallel(patch, *source, num_cores);
+                }
+                writer.push(name, job->output_path, std::move(output));
+            }
+            catch (std::exception& e) {
+                cout << "Error with " << job->patch_path.filename() << "\n"
+                     << e.what()
+                     << endl;
+            }
+            print_saved(writer.take_results());
+        }
+
+        sources.release(group.src->ref_crc);
+    }
+
+    writer.wait();
+    print_saved(writer.take_results());
+
+    report_timing("generate");
 }
 
 
 void
-export_system_fonts(const std::map<uint32_t, font_info>& cafe_fonts)
+export_system_fonts()
 {
     cout << "Exporting system fonts..." << endl;
-    for (auto [crc, info] : cafe_fonts) {
+    log_sink::flush();
+    for (const auto& src : cafe_fonts::sources) {
         try {
-            path out_path = sd_fonts_path / info.name;
+            path out_path = sd_fonts_path / src.name;
             if (exists(out_path)) {
-                cout << "Skipped " << info.name << ": already exists" << endl;
+                cout << "Skipped " << src.name << ": already exists" << endl;
                 continue;
             }
-            save_file(out_path, info.content);
-            cout << "Exported " << info.name;
-            if (crc != info.ref_crc)
+            auto crc = cafe_fonts::export_to(src, out_path);
+            cout << "Exported " << src.name;
+            if (crc != src.ref_crc)
                 cout << " (wrong crc32)";
             cout << endl;
+            timing::print_file(src.name);
         }
         catch (std::exception& e) {
-            cout << "Error with " << info.name << "\n"
+            cout << "Error with " << src.name << "\n"
                  << e.what()
                  << endl;
         }
     }
+
+    report_timing("export");
 }
 
 
-template<typename... Ts>
-struct overloaded : Ts... {
-    using Ts::operator() ...;
+void
+compress_custom_fonts()
+{
+    std::vector<path> font_paths;
+    for (const auto& entry : std::filesystem::directory_iterator{sd_fonts_path}) {
+        if (!entry.is_regular_file())
+            continue;
+        if (has_extension(entry, ".ttf"))
+            font_paths.push_back(entry.path());
+    }
+    const auto cfg = load_settings();
+    async_writer writer{cfg.write_queue_mib * 1024 * 1024};
+
+    cout << "Compressing fonts..." << endl;
+    log_sink::flush();
+    for (const auto& font_path : font_paths) {
+        try {
+            path output_path = font_path;
+            output_path += ".lz4";
+            if (exists(output_path)) {
+                cout << "Skipped: "
+                     << output_path.filename()
+                     << " already exists."
+                     << endl;
+                continue;
+            }
+
+            const auto name = font_path.filename().string();
+            blob_t font;
+            {
+                timing::scope t{name, timing::phase::load};
+                font = load_file(font_path);
+                t.set_bytes(font.size());
+            }
+            cout << "Processing " << font_path.filename() << endl;
+            log_sink::flush();
+            blob_t output;
+            {
+                timing::scope t{name, timing::phase::compress, font.size()};
+                output = lz4::compress(font);
+            }
+            cout << "Compressed " << font_path.filename()
+                 << " (" << (output.size() * 100 / font.size()) << "%)"
+                 << endl;
+            writer.push(name, output_path, std::move(output));
+        }
+        catch (std::exception& e) {
+            cout << "Error with " << font_path.filename() << "\n"
+                 << e.what()
+                 << endl;
+        }
+        print_saved(writer.take_results());
+    }
+
+    writer.wait();
+    print_saved(writer.take_results());
+
+    report_timing("compress");
+}
+
+
+// Reads the file in chunks, without keeping it in memory.
+uint32_t
+file_crc32(const path& file_path)
+{
+    std::filebuf fb;
+    if (!fb.open(file_path, std::ios::in | std::ios::binary))
+        throw std::runtime_error{"unable to open for reading"};
+
+    blob_t buf(256 * 1024);
+    uint32_t crc = 0;
+    for (;;) {
+        auto read = fb.sgetn(reinterpret_cast<char*>(buf.data()), buf.size());
+        if (read < 0)
+            throw std::runtime_error{"error reading file"};
+        if (read == 0)
+            return crc;
+        crc = calc_crc32(std::span{buf.data(), static_cast<std::size_t>(read)}, crc);
+    }
+}
+
+
+struct verify_item {
+    path file;
+    std::uintmax_t expected_size; // 0 means any size
+    uint32_t expected_crc;
+
+    // What to do if it fails.
+    path patch_path{};
+    const cafe_fonts::source* exported = nullptr;
+
+    std::uintmax_t size = 0;
+    std::string error{};        // empty if verified
 };
 
 
+void
+verify_one(verify_item& item)
+{
+    const auto name = item.file.filename().string();
+    try {
+        item.size = file_size(item.file);
+        if (item.expected_size && item.size != item.expected_size)
+            throw std::runtime_error{"wrong size: " + std::to_string(item.size)
+                                     + " bytes, expected "
+                                     + std::to_string(item.expected_size)};
+
+        timing::scope t{name, timing::phase::hash, item.size};
+        if (file_crc32(item.file) != item.expected_crc)
+            throw std::runtime_error{"wrong crc32"};
+    }
+    catch (std::exception& e) {
+        item.error = e.what();
+    }
+}
+
+
+/*
+ * Checks the generated fonts against their patches, and the system fonts (and their
+ * exported copies) against the reference CRC32s. Whatever failed is generated or
+ * exported again.
+ */
+void
+verify_fonts(cafe_fonts::registry& sources)
+{
+    std::vector<verify_item> items;
+
+    for (const auto& src : cafe_fonts::sources) {
+        items.push_back({.file = cafe_fonts::get_path(src),
+                         .expected_size = 0,
+                         .expected_crc = src.ref_crc});
+        path exported_path = sd_fonts_path / src.name;
+        if (exists(exported_path))
+            items.push_back({.file = exported_path,
+                             .expected_size = 0,
+                             .expected_crc = src.ref_crc,
+                             .exported = &src});
+    }
+
+    for (const auto& patch_path : find_patches()) {
+        path output_path = patch_path;
+        output_path.replace_extension(".ttf");
+        if (!exists(output_path))
+            continue;
+        try {
+            auto info = read_patch_info(patch_path);
+            items.push_back({.file = output_path,
+                             .expected_size = info.size_out,
+                             .expected_crc = info.crc_out,
+                             .patch_path = patch_path});
+        }
+        catch (std::exception& e) {
+            cout << "Error with " << patch_path.filename() << "\n"
+                 << e.what()
+                 << endl;
+        }
+    }
+
+    cout << "Verifying " << items.size() << " fonts..." << endl;
+    log_sink::flush();
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::atomic_size_t next = 0;
+        auto worker = [&items, &next]
+        {
+            for (std::size_t i = next++; i < items.size(); i = next++)
+                verify_one(items[i]);
+        };
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < num_cores; ++t)
+            threads.emplace_back(worker);
+        for (auto& t : threads)
+            t.join();
+    }
+    const auto finish = std::chrono::steady_clock::now();
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start);
+
+    std::uintmax_t total_size = 0;
+    std::vector<path> failed_patches;
+    unsigned failures = 0;
+    for (const auto& item : items) {
+        total_size += item.size;
+        if (item.error.empty()) {
+            cout << "OK: " << item.file.filename() << endl;
+            continue;
+        }
+        ++failures;
+        cout << "FAILED: " << item.file.filename() << " (" << item.error << ")" << endl;
+        try {
+            if (!item.patch_path.empty()) {
+                std::filesystem::remove(item.file);
+                failed_patches.push_back(item.patch_path);
+            } else if (item.exported) {
+                std::filesystem::remove(item.file);
+                cafe_fonts::export_to(*item.exported, item.file);
+                cout << "Exported " << item.exported->name << " again" << endl;
+            }
+        }
+        catch (std::exception& e) {
+            cout << "Error with " << item.file.filename() << "\n"
+                 << e.what()
+                 << endl;
+        }
+    }
+
+    cout << "Verified " << (total_size / 1024) << " KiB in " << ms.count() << " ms";
+    if (ms.count())
+        cout << " (" << (total_size / 1024 * 1000 / ms.count()) << " KiB/s)";
+    cout << ", " << failures << " failed." << endl;
+
+    if (!failed_patches.empty())
+        generate_custom_fonts(sources, failed_patches, {});
+    else
+        report_timing("verify");
+}
+
+
 int main()
 {
     kpad kpad_guard;
@@ -503,124 +1265,53 @@ int main()
     cout << PACKAGE_URL << endl;
 
     try {
-        // Look up system fonts by crc32.
-        std::map<uint32_t, font_info> cafe_fonts;
-        {
-            mocha::init_guard mocha_init;
-            mocha::mount_guard mount_mlc_guard{"storage_mlc", {}, "/vol/storage_mlc01"};
-
-            const auto cafe_names = {
-                "CafeCn.ttf",
-                "CafeKr.ttf",
-                "CafeStd.ttf",
-                "CafeTw.ttf",
-            };
-            const auto cafe_crcs = {
-                0X14c7272fu, // CafeCn.ttf
-                0Xa2a1a55au, // CafeKr.ttf
-                0Xf1252709u, // CafeStd.ttf
-                0Xe5a938cdu, // CafeTw.ttf
-            };
-            const path cafe_base_path = "storage_mlc:/sys/title/0005001b/10042400/content";
-            for (auto [name, ref_crc] : std::views::zip(cafe_names, cafe_crcs)) {
-                path cafe_font_path = cafe_base_path / name;
-                try {
-                    blob_t content = load_file(cafe_font_path);
-                    auto real_crc = calc_crc32(content);
-                    const char* crc_match = real_crc == ref_crc ? "OK" : "wrong crc32";
-                    cout << "Loaded "
-                         << std::setw(7) << name
-                         << " (" << crc_match << ")"
-                         << endl;
-                    auto& info = cafe_fonts[real_crc];
-                    info.ref_crc = ref_crc;
-                    info.name    = name;
-                    info.content = std::move(content);
-                }
-                catch (std::exception& e) {
-                    cout << "Error with \"" << name << "\":\n"
-                         << e.what()
-                         << endl;
-                }
-            }
-        }
+        mocha::init_guard mocha_init;
+        mocha::mount_guard mount_mlc_guard{"storage_mlc", {}, "/vol/storage_mlc01"};
+
+        // System fonts are only loaded when a patch needs them.
+        cafe_fonts::registry cafe_sources;
 
         if (!exists(sd_fonts_path))
             throw std::runtime_error{"\"SD:/wiiu/fonts/\" not found!"};
 
         cout << "\nWaiting for user input:\n"
-             << "  - press A button to generate fonts.\n"
+             << "  - press A button to generate fonts (.bps, .woff, .woff2).\n"
              << "  - press + button to export the system fonts.\n"
+             << "  - press Y button (1 on Wii Remote) to compress fonts.\n"
+             << "  - press X button (2 on Wii Remote) to show the patch plan.\n"
+             << "  - press - button to verify the fonts.\n"
              << "  - press any other button to exit."
              << endl;
         cout << "\n**This safe, it will NOT modify your NAND.**" << endl;
 
-        auto btn = wait_for_action_button();
-
-        auto handle_vpad = [&cafe_fonts](VPADButtons btn)
-        {
-            if (btn & VPAD_BUTTON_A) {
-                generate_custom_fonts(cafe_fonts);
-                return;
-            }
-            if (btn & VPAD_BUTTON_PLUS) {
-                export_system_fonts(cafe_fonts);
-                return;
-            }
+        switch (wait_for_action()) {
+        case action::generate:
+            generate_custom_fonts(cafe_sources, find_patches(), find_web_fonts());
+            break;
+        case action::export_fonts:
+            export_system_fonts();
+            break;
+        case action::compress:
+            compress_custom_fonts();
+            break;
+        case action::show_plan:
+            show_patch_plan();
+            break;
+        case action::verify:
+            verify_fonts(cafe_sources);
+            break;
+        case action::cancel:
             throw std::runtime_error{"Canceled by user."};
-        };
-        auto handle_wpad = [&cafe_fonts](WPADButton btn)
-        {
-            if (btn & WPAD_BUTTON_A) {
-                generate_custom_fonts(cafe_fonts);
-                return;
-            }
-            if (btn & WPAD_BUTTON_PLUS) {
-                export_system_fonts(cafe_fonts);
-                return;
-            }
-            throw std::runtime_error{"Canceled by user."};
-        };
-        auto handle_wpad_nunchuk = [&cafe_fonts](WPADNunchukButton)
-        {
-            throw std::runtime_error{"Canceled by user."};
-        };
-        auto handle_wpad_classic = [&cafe_fonts](WPADClassicButton btn)
-        {
-            if (btn & WPAD_CLASSIC_BUTTON_A) {
-                generate_custom_fonts(cafe_fonts);
-                return;
-            }
-            if (btn & WPAD_CLASSIC_BUTTON_PLUS) {
-                export_system_fonts(cafe_fonts);
-                return;
-            }
-            throw std::runtime_error{"Canceled by user."};
-        };
-        auto handle_wpad_pro = [&cafe_fonts](WPADProButton btn)
-        {
-            if (btn & WPAD_PRO_BUTTON_A) {
-                generate_custom_fonts(cafe_fonts);
-                return;
-            }
-            if (btn & WPAD_PRO_BUTTON_PLUS) {
-                export_system_fonts(cafe_fonts);
-                return;
-            }
-            throw std::runtime_error{"Canceled by user."};
-        };
-        visit(overloaded{handle_vpad,
-                         handle_wpad,
-                         handle_wpad_nunchuk,
-                         handle_wpad_classic,
-                         handle_wpad_pro},
-            btn);
+        }
+
+#ifdef ENABLE_ALLOC_STATS
+        alloc_stats::report([](const char* line) { cout << line << endl; });
+#endif
 
         cout << "\nFinished." << "\n"
              << "Press HOME and close this app." << endl;
 
-        while (proc.is_running())
-            console.draw();
+        wait_for_exit();
 
     }
     catch (whb::proc::quit) {
@@ -632,7 +1323,6 @@ int main()
              << "Press HOME and close this app."
              << endl;
 
-        while (proc.is_running())
-            console.draw();
+        wait_for_exit();
     }
 }
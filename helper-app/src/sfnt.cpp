@@ -0,0 +1,1510 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Based on the OpenType specification, chapters "cmap", "glyf", "hmtx", "loca", "maxp" and
+// "name".
+
+#include <algorithm>
+#include <cstring>              // memcpy()
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <numeric>              // iota()
+
+#include "sfnt.hpp"
+
+
+using std::byte;
+using std::int16_t;
+using std::int32_t;
+using std::int64_t;
+using std::uint64_t;
+using std::size_t;
+using std::span;
+using std::to_string;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint8_t;
+
+using namespace std::literals;
+
+
+namespace sfnt {
+
+    error::error(const char* msg) :
+        std::runtime_error{"sfnt error: "s + msg}
+    {}
+
+
+    error::error(const std::string& msg) :
+        std::runtime_error{"sfnt error: "s + msg}
+    {}
+
+
+    namespace {
+
+        const tag_t tag_cmap = make_tag("cmap");
+        const tag_t tag_glyf = make_tag("glyf");
+        const tag_t tag_head = make_tag("head");
+        const tag_t tag_hhea = make_tag("hhea");
+        const tag_t tag_hmtx = make_tag("hmtx");
+        const tag_t tag_kern = make_tag("kern");
+        const tag_t tag_loca = make_tag("loca");
+        const tag_t tag_maxp = make_tag("maxp");
+        const tag_t tag_names = make_tag("name");
+        const tag_t tag_os2  = make_tag("OS/2");
+        const tag_t tag_post = make_tag("post");
+
+        // Tables that depend on the glyph count, but are optional.
+        const tag_t dropped_tags[] = {
+            make_tag("DSIG"),
+            make_tag("LTSH"),
+            make_tag("hdmx"),
+            make_tag("vhea"),
+            make_tag("vmtx"),
+        };
+
+        // Tables with values in font units that are not rescaled, so they're dropped when
+        // the first font changes its em size.
+        const tag_t unscaled_tags[] = {
+            make_tag("BASE"),
+            make_tag("GPOS"),
+            make_tag("MATH"),
+            make_tag("VORG"),
+            make_tag("cvt "),
+            make_tag("fpgm"),
+            make_tag("prep"),
+        };
+
+
+        std::string
+        tag_name(tag_t tag)
+        {
+            std::string result(4, ' ');
+            for (unsigned i = 0; i < 4; ++i)
+                result[i] = char(tag >> (24 - 8 * i));
+            return result;
+        }
+
+
+        uint8_t
+        get_u8(span<const byte> data, size_t offset)
+        {
+            if (offset + 1 > data.size())
+                throw error{"read past end of data, offset=" + to_string(offset)};
+            return to_integer<uint8_t>(data[offset]);
+        }
+
+
+        uint16_t
+        get_u16(span<const byte> data, size_t offset)
+        {
+            if (offset + 2 > data.size())
+                throw error{"read past end of data, offset=" + to_string(offset)};
+            return to_integer<uint16_t>(data[offset]) << 8
+                |  to_integer<uint16_t>(data[offset + 1]);
+        }
+
+
+        int16_t
+        get_i16(span<const byte> data, size_t offset)
+        {
+            return static_cast<int16_t>(get_u16(data, offset));
+        }
+
+
+        uint32_t
+        get_u32(span<const byte> data, size_t offset)
+        {
+            return uint32_t{get_u16(data, offset)} << 16 | get_u16(data, offset + 2);
+        }
+
+
+        void
+        put_u16(span<byte> data, size_t offset, uint16_t val)
+        {
+            if (offset + 2 > data.size())
+                throw error{"write past end of data, offset=" + to_string(offset)};
+            data[offset]     = byte(val >> 8);
+            data[offset + 1] = byte(val);
+        }
+
+
+        void
+        put_u32(span<byte> data, size_t offset, uint32_t val)
+        {
+            put_u16(data, offset,     val >> 16);
+            put_u16(data, offset + 2, val);
+        }
+
+
+        struct byte_writer {
+
+            std::vector<byte> data;
+
+
+            void
+            u8(uint8_t val)
+            {
+                data.push_back(byte{val});
+            }
+
+
+            void
+            u16(uint16_t val)
+            {
+                data.push_back(byte(val >> 8));
+                data.push_back(byte(val));
+            }
+
+
+            void
+            i16(int16_t val)
+            {
+                u16(static_cast<uint16_t>(val));
+            }
+
+
+            void
+            u32(uint32_t val)
+            {
+                u16(val >> 16);
+                u16(val);
+            }
+
+
+            void
+            bytes(span<const byte> blob)
+            {
+                data.insert(data.end(), blob.begin(), blob.end());
+            }
+
+
+            void
+            align4()
+            {
+                while (data.size() % 4)
+                    data.push_back(byte{0});
+            }
+
+        };
+
+
+        std::vector<byte>
+        copy_of(span<const byte> data)
+        {
+            return {data.begin(), data.end()};
+        }
+
+
+        size_t
+        align4(size_t size)
+            noexcept
+        {
+            return (size + 3) & ~size_t{3};
+        }
+
+
+        cmap_t
+        parse_cmap_format4(span<const byte> sub,
+                           unsigned num_glyphs)
+        {
+            cmap_t result;
+            const unsigned seg_count = get_u16(sub, 6) / 2;
+            const size_t end_codes   = 14;
+            const size_t start_codes = end_codes + 2 * seg_count + 2;
+            const size_t id_deltas   = start_codes + 2 * seg_count;
+            const size_t id_ranges   = id_deltas + 2 * seg_count;
+            for (unsigned seg = 0; seg < seg_count; ++seg) {
+                const uint16_t end   = get_u16(sub, end_codes + 2 * seg);
+                const uint16_t start = get_u16(sub, start_codes + 2 * seg);
+                const uint16_t delta = get_u16(sub, id_deltas + 2 * seg);
+                const uint16_t range = get_u16(sub, id_ranges + 2 * seg);
+                if (start > end)
+                    continue;
+                for (uint32_t c = start; c <= end && c != 0xffff; ++c) {
+                    uint16_t g;
+                    if (!range)
+                        g = c + delta;
+                    else {
+                        g = get_u16(sub, id_ranges + 2 * seg + range + 2 * (c - start));
+                        if (g)
+                            g += delta;
+                    }
+                    if (g && g < num_glyphs)
+                        result.emplace_back(c, g);
+                }
+            }
+            return result;
+        }
+
+
+        cmap_t
+        parse_cmap_format12(span<const byte> sub,
+                            unsigned num_glyphs)
+        {
+            cmap_t result;
+            const uint32_t num_groups = get_u32(sub, 12);
+            if (num_groups > (sub.size() - 16) / 12)
+                throw error{"bad cmap format 12 group count"};
+            for (uint32_t i = 0; i < num_groups; ++i) {
+                const size_t group = 16 + 12 * i;
+                const uint32_t start = get_u32(sub, group);
+                const uint32_t end   = std::min<uint32_t>(get_u32(sub, group + 4), 0x10ffff);
+                const uint32_t glyph = get_u32(sub, group + 8);
+                for (uint32_t c = start; c <= end; ++c) {
+                    uint32_t g = glyph + (c - start);
+                    if (g >= num_glyphs)
+                        break;
+                    if (g)
+                        result.emplace_back(c, g);
+                }
+            }
+            return result;
+        }
+
+
+        int32_t
+        scale_value(int32_t val, unsigned num, unsigned den)
+            noexcept
+        {
+            if (num == den)
+                return val;
+            int64_t t = int64_t{val} * num;
+            t = t >= 0 ? (t + den / 2) / den : (t - den / 2) / den;
+            return std::clamp<int64_t>(t,
+                                       std::numeric_limits<int16_t>::min(),
+                                       std::numeric_limits<int16_t>::max());
+        }
+
+
+        uint16_t
+        scale_unsigned(uint16_t val, unsigned num, unsigned den)
+            noexcept
+        {
+            if (num == den)
+                return val;
+            const uint64_t t = (uint64_t{val} * num + den / 2) / den;
+            return std::min<uint64_t>(t, 0xffff);
+        }
+
+
+        // Simple glyph flags.
+        const uint8_t on_curve       = 0x01;
+        const uint8_t x_short        = 0x02;
+        const uint8_t y_short        = 0x04;
+        const uint8_t repeat         = 0x08;
+        const uint8_t x_same_or_pos  = 0x10;
+        const uint8_t y_same_or_pos  = 0x20;
+        const uint8_t overlap_simple = 0x40;
+
+        // Composite glyph flags.
+        const uint16_t args_are_words    = 0x0001;
+        const uint16_t args_are_xy       = 0x0002;
+        const uint16_t have_scale        = 0x0008;
+        const uint16_t more_components   = 0x0020;
+        const uint16_t have_xy_scale     = 0x0040;
+        const uint16_t have_2x2          = 0x0080;
+        const uint16_t have_instructions = 0x0100;
+
+
+        struct glyph_info {
+            unsigned points = 0;
+            unsigned contours = 0;
+            unsigned components = 0;
+            unsigned depth = 0;
+        };
+
+
+        struct bbox {
+            int16_t x_min = 0;
+            int16_t y_min = 0;
+            int16_t x_max = 0;
+            int16_t y_max = 0;
+        };
+
+
+        // Copies glyphs from another font, scaling them and stripping their instructions.
+        struct glyph_importer {
+
+            const font& src;
+            const unsigned num;
+            const unsigned den;
+            const unsigned base_id;
+
+            // Maps a glyph from src to its new ID; 0 means not imported.
+            std::vector<uint32_t> new_ids;
+            std::vector<uint16_t> order;
+            std::vector<glyph_info> infos;
+
+
+            glyph_importer(const font& src,
+                           unsigned dst_em,
+                           unsigned base_id) :
+                src{src},
+                num{dst_em},
+                den{src.units_per_em()},
+                base_id{base_id},
+                new_ids(src.num_glyphs(), 0)
+            {}
+
+
+            int16_t
+            scale(int32_t val)
+                const noexcept
+            {
+                return scale_value(val, num, den);
+            }
+
+
+            // Returns the new ID of the glyph.
+            uint16_t
+            import(unsigned id,
+                   unsigned level = 0)
+            {
+                if (id >= new_ids.size())
+                    throw error{"glyph index out of range: " + to_string(id)};
+                if (new_ids[id])
+                    return new_ids[id];
+                if (level > 16)
+                    throw error{"composite glyph nesting is too deep"};
+
+                const uint32_t new_id = base_id + order.size();
+                if (new_id > 0xffff)
+                    throw error{"too many glyphs"};
+                new_ids[id] = new_id;
+                order.push_back(id);
+                infos.emplace_back();
+
+                glyph_info info;
+                auto data = src.glyph(id);
+                if (data.size() >= 10 && get_i16(data, 0) < 0) {
+                    // composite: import the components too
+                    size_t pos = 10;
+                    uint16_t flags;
+                    do {
+                        flags = get_u16(data, pos);
+                        const uint16_t component = get_u16(data, pos + 2);
+                        import(component, level + 1);
+                        const auto& child = infos[new_ids[component] - base_id];
+                        info.points   += child.points;
+                        info.contours += child.contours;
+                        info.depth = std::max(info.depth, child.depth + 1);
+                        ++info.components;
+                        pos += 4 + (flags & args_are_words ? 4 : 2);
+                        if (flags & have_scale)
+                            pos += 2;
+                        else if (flags & have_xy_scale)
+                            pos += 4;
+                        else if (flags & have_2x2)
+                            pos += 8;
+                    } while (flags & more_components);
+                } else if (data.size() >= 10) {
+                    const int16_t contours = get_i16(data, 0);
+                    info.contours = contours;
+                    if (contours > 0)
+                        info.points = get_u16(data, 10 + 2 * (contours - 1)) + 1u;
+                }
+                infos[new_id - base_id] = info;
+                return new_id;
+            }
+
+
+            std::vector<byte>
+            convert_simple(span<const byte> data,
+                           bbox& box)
+                const
+            {
+                const int16_t contours = get_i16(data, 0);
+                std::vector<uint16_t> end_points(contours);
+                for (int i = 0; i < contours; ++i)
+                    end_points[i] = get_u16(data, 10 + 2 * i);
+                const unsigned num_points = contours ? end_points.back() + 1u : 0u;
+                size_t pos = 10 + 2 * contours;
+                const uint16_t instr_len = get_u16(data, pos);
+                pos += 2 + instr_len;
+
+                std::vector<uint8_t> flags;
+                flags.reserve(num_points);
+                while (flags.size() < num_points) {
+                    uint8_t f = get_u8(data, pos++);
+                    flags.push_back(f);
+                    if (f & repeat) {
+                        unsigned count = get_u8(data, pos++);
+                        while (count-- && flags.size() < num_points)
+                            flags.push_back(f);
+                    }
+                }
+
+                std::vector<int32_t> xs(num_points);
+                std::vector<int32_t> ys(num_points);
+                int32_t coord = 0;
+                for (unsigned i = 0; i < num_points; ++i) {
+                    if (flags[i] & x_short) {
+                        int32_t d = get_u8(data, pos++);
+                        coord += flags[i] & x_same_or_pos ? d : -d;
+                    } else if (!(flags[i] & x_same_or_pos)) {
+                        coord += get_i16(data, pos);
+                        pos += 2;
+                    }
+                    xs[i] = coord;
+                }
+                coord = 0;
+                for (unsigned i = 0; i < num_points; ++i) {
+                    if (flags[i] & y_short) {
+                        int32_t d = get_u8(data, pos++);
+                        coord += flags[i] & y_same_or_pos ? d : -d;
+                    } else if (!(flags[i] & y_same_or_pos)) {
+                        coord += get_i16(data, pos);
+                        pos += 2;
+                    }
+                    ys[i] = coord;
+                }
+
+                for (unsigned i = 0; i < num_points; ++i) {
+                    xs[i] = scale(xs[i]);
+                    ys[i] = scale(ys[i]);
+                }
+
+                if (num_points) {
+                    auto [x_min, x_max] = std::minmax_element(xs.begin(), xs.end());
+                    auto [y_min, y_max] = std::minmax_element(ys.begin(), ys.end());
+                    box = { int16_t(*x_min), int16_t(*y_min), int16_t(*x_max), int16_t(*y_max) };
+                } else
+                    box = {
+                        scale(get_i16(data, 2)),
+                        scale(get_i16(data, 4)),
+                        scale(get_i16(data, 6)),
+                        scale(get_i16(data, 8)),
+                    };
+
+                byte_writer out;
+                out.i16(contours);
+                out.i16(box.x_min);
+                out.i16(box.y_min);
+                out.i16(box.x_max);
+                out.i16(box.y_max);
+                for (auto e : end_points)
+                    out.u16(e);
+                out.u16(0); // no instructions
+
+                byte_writer x_out;
+                byte_writer y_out;
+                int32_t prev_x = 0;
+                int32_t prev_y = 0;
+                for (unsigned i = 0; i < num_points; ++i) {
+                    uint8_t f = flags[i] & (on_curve | (i == 0 ? overlap_simple : 0));
+
+                    const int32_t dx = xs[i] - prev_x;
+                    prev_x = xs[i];
+                    if (dx == 0)
+                        f |= x_same_or_pos;
+                    else if (dx >= -255 && dx <= 255) {
+                        f |= x_short;
+                        if (dx > 0)
+                            f |= x_same_or_pos;
+                        x_out.u8(dx > 0 ? dx : -dx);
+                    } else
+                        x_out.i16(dx);
+
+                    const int32_t dy = ys[i] - prev_y;
+                    prev_y = ys[i];
+                    if (dy == 0)
+                        f |= y_same_or_pos;
+                    else if (dy >= -255 && dy <= 255) {
+                        f |= y_short;
+                        if (dy > 0)
+                            f |= y_same_or_pos;
+                        y_out.u8(dy > 0 ? dy : -dy);
+                    } else
+                        y_out.i16(dy);
+
+                    out.u8(f);
+                }
+                out.bytes(x_out.data);
+                out.bytes(y_out.data);
+                return std::move(out.data);
+            }
+
+
+            std::vector<byte>
+            convert_composite(span<const byte> data,
+                              bbox& box)
+                const
+            {
+                box = {
+                    scale(get_i16(data, 2)),
+                    scale(get_i16(data, 4)),
+                    scale(get_i16(data, 6)),
+                    scale(get_i16(data, 8)),
+                };
+
+                byte_writer out;
+                out.i16(-1);
+                out.i16(box.x_min);
+                out.i16(box.y_min);
+                out.i16(box.x_max);
+                out.i16(box.y_max);
+
+                size_t pos = 10;
+                uint16_t flags;
+                do {
+                    flags = get_u16(data, pos);
+                    const uint16_t component = get_u16(data, pos + 2);
+                    pos += 4;
+
+                    int32_t arg1;
+                    int32_t arg2;
+                    if (flags & args_are_words) {
+                        arg1 = flags & args_are_xy ? get_i16(data, pos)     : get_u16(data, pos);
+                        arg2 = flags & args_are_xy ? get_i16(data, pos + 2) : get_u16(data, pos + 2);
+                        pos += 4;
+                    } else {
+                        arg1 = get_u8(data, pos);
+                        arg2 = get_u8(data, pos + 1);
+                        if (flags & args_are_xy) {
+                            arg1 = static_cast<int8_t>(arg1);
+                            arg2 = static_cast<int8_t>(arg2);
+                        }
+                        pos += 2;
+                    }
+
+                    size_t transform_size = 0;
+                    if (flags & have_scale)
+                        transform_size = 2;
+                    else if (flags & have_xy_scale)
+                        transform_size = 4;
+                    else if (flags & have_2x2)
+                        transform_size = 8;
+                    if (pos + transform_size > data.size())
+                        throw error{"truncated composite glyph"};
+                    auto transform = data.subspan(pos, transform_size);
+                    pos += transform_size;
+
+                    uint16_t new_flags = flags & ~have_instructions;
+                    if (flags & args_are_xy) {
+                        // offsets get scaled, and always stored as words
+                        arg1 = scale(arg1);
+                        arg2 = scale(arg2);
+                        new_flags |= args_are_words;
+                    }
+
+                    out.u16(new_flags);
+                    out.u16(new_ids.at(component));
+                    if (new_flags & args_are_words) {
+                        out.u16(static_cast<uint16_t>(arg1));
+                        out.u16(static_cast<uint16_t>(arg2));
+                    } else {
+                        out.u8(arg1);
+                        out.u8(arg2);
+                    }
+                    out.bytes(transform);
+                } while (flags & more_components);
+
+                return std::move(out.data);
+            }
+
+
+            // Returns the converted glyph data, and its bounding box.
+            std::vector<byte>
+            convert(unsigned id,
+                    bbox& box)
+                const
+            {
+                auto data = src.glyph(id);
+                box = {};
+                if (data.empty())
+                    return {};
+                if (data.size() < 10)
+                    throw error{"truncated glyph " + to_string(id)};
+                if (get_i16(data, 0) < 0)
+                    return convert_composite(data, box);
+                return convert_simple(data, box);
+            }
+
+
+            // The left side bearing must match the converted glyph's x_min.
+            metric
+            convert_metric(unsigned id,
+                           bool empty,
+                           const bbox& box)
+                const
+            {
+                auto m = src.get_metric(id);
+                return {
+                    scale_unsigned(m.advance, num, den),
+                    empty ? scale(m.lsb) : box.x_min,
+                };
+            }
+
+
+            // Fields too far for an older version of the table are skipped.
+            void
+            scale_fields(std::vector<byte>& table,
+                         std::initializer_list<size_t> offsets)
+                const
+            {
+                for (auto offset : offsets)
+                    if (offset + 2 <= table.size())
+                        put_u16(table, offset, scale(get_i16(table, offset)));
+            }
+
+
+            void
+            scale_unsigned_fields(std::vector<byte>& table,
+                                  std::initializer_list<size_t> offsets)
+                const
+            {
+                for (auto offset : offsets)
+                    if (offset + 2 <= table.size())
+                        put_u16(table, offset,
+                                scale_unsigned(get_u16(table, offset), num, den));
+            }
+
+        };
+
+
+        /*
+         * Only handles the common kern table: version 0, with format 0 subtables. Returns an
+         * empty table for anything else, so it gets dropped.
+         */
+        std::vector<byte>
+        scale_kern(span<const byte> kern,
+                   const glyph_importer& scaler)
+        {
+            if (get_u16(kern, 0) != 0)
+                return {};
+            auto result = copy_of(kern);
+            const unsigned num_tables = get_u16(kern, 2);
+            size_t pos = 4;
+            for (unsigned t = 0; t < num_tables; ++t) {
+                const uint16_t coverage = get_u16(kern, pos + 4);
+                if (coverage >> 8 != 0)
+                    return {};
+                const unsigned num_pairs = get_u16(kern, pos + 6);
+                // The subtable length overflows on big tables, so it's not used.
+                pos += 14;
+                for (unsigned i = 0; i < num_pairs; ++i, pos += 6)
+                    put_u16(result, pos + 4, scaler.scale(get_i16(kern, pos + 4)));
+            }
+            return result;
+        }
+
+
+        std::vector<byte>
+        build_cmap_format4(const cmap_t& map)
+        {
+            struct segment {
+                uint16_t start;
+                uint16_t end;
+                uint16_t delta;
+                int32_t array_start = -1; // index into glyph_array, or -1 if using delta
+            };
+
+            std::vector<segment> segments;
+            std::vector<uint16_t> glyph_array;
+
+            // Split into runs of contiguous code points.
+            size_t i = 0;
+            while (i < map.size() && map[i].first < 0xffff) {
+                size_t run_end = i + 1;
+                while (run_end < map.size()
+                       && map[run_end].first < 0xffff
+                       && map[run_end].first == map[run_end - 1].first + 1)
+                    ++run_end;
+
+                // Inside a run, long stretches with the same delta get their own
+                // segment, everything else goes into the glyph array.
+                size_t pending = i;
+                size_t j = i;
+                while (j < run_end) {
+                    const uint16_t delta = map[j].second - map[j].first;
+                    size_t k = j + 1;
+                    while (k < run_end && uint16_t(map[k].second - map[k].first) == delta)
+                        ++k;
+                    if (k - j >= 4) {
+                        if (pending < j) {
+                            segments.push_back({uint16_t(map[pending].first),
+                                                uint16_t(map[j - 1].first),
+                                                0,
+                                                int32_t(glyph_array.size())});
+                            for (size_t p = pending; p < j; ++p)
+                                glyph_array.push_back(map[p].second);
+                        }
+                        segments.push_back({uint16_t(map[j].first),
+                                            uint16_t(map[k - 1].first),
+                                            delta});
+                        pending = k;
+                    }
+                    j = k;
+                }
+                if (pending < run_end) {
+                    segments.push_back({uint16_t(map[pending].first),
+                                        uint16_t(map[run_end - 1].first),
+                                        0,
+                                        int32_t(glyph_array.size())});
+                    for (size_t p = pending; p < run_end; ++p)
+                        glyph_array.push_back(map[p].second);
+                }
+
+                i = run_end;
+            }
+            // The mandatory last segment.
+            segments.push_back({0xffff, 0xffff, 1});
+
+            const size_t seg_count = segments.size();
+            const size_t length = 16 + 8 * seg_count + 2 * glyph_array.size();
+            if (length > 0xffff)
+                return {};
+
+            unsigned entry_selector = 0;
+            while ((2u << entry_selector) <= seg_count)
+                ++entry_selector;
+            const unsigned search_range = 2u << entry_selector;
+
+            byte_writer out;
+            out.u16(4);
+            out.u16(length);
+            out.u16(0); // language
+            out.u16(2 * seg_count);
+            out.u16(search_range);
+            out.u16(entry_selector);
+            out.u16(2 * seg_count - search_range);
+            for (auto& s : segments)
+                out.u16(s.end);
+            out.u16(0); // reservedPad
+            for (auto& s : segments)
+                out.u16(s.start);
+            for (auto& s : segments)
+                out.u16(s.delta);
+            for (size_t idx = 0; idx < seg_count; ++idx) {
+                const auto& s = segments[idx];
+                if (s.array_start < 0)
+                    out.u16(0);
+                else
+                    out.u16(2 * (seg_count - idx) + 2 * s.array_start);
+            }
+            for (auto g : glyph_array)
+                out.u16(g);
+            return std::move(out.data);
+        }
+
+
+        std::vector<byte>
+        build_cmap_format12(const cmap_t& map)
+        {
+            struct group {
+                uint32_t start;
+                uint32_t end;
+                uint32_t glyph;
+            };
+            std::vector<group> groups;
+            for (auto [c, g] : map) {
+                if (!groups.empty()
+                    && groups.back().end + 1 == c
+                    && groups.back().glyph + (c - groups.back().start) == g)
+                    groups.back().end = c;
+                else
+                    groups.push_back({c, c, g});
+            }
+
+            byte_writer out;
+            out.u16(12);
+            out.u16(0);
+            out.u32(16 + 12 * groups.size());
+            out.u32(0); // language
+            out.u32(groups.size());
+            for (auto& g : groups) {
+                out.u32(g.start);
+                out.u32(g.end);
+                out.u32(g.glyph);
+            }
+            return std::move(out.data);
+        }
+
+
+        std::vector<byte>
+        build_cmap(const cmap_t& map)
+        {
+            auto f4 = build_cmap_format4(map);
+            const bool need_f12 = f4.empty() || (!map.empty() && map.back().first > 0xffff);
+            std::vector<byte> f12;
+            if (need_f12)
+                f12 = build_cmap_format12(map);
+
+            const unsigned num_tables = (f4.empty() ? 0 : 1) + (f12.empty() ? 0 : 1);
+            byte_writer out;
+            out.u16(0);
+            out.u16(num_tables);
+            uint32_t offset = 4 + 8 * num_tables;
+            if (!f4.empty()) {
+                out.u16(3); // Windows
+                out.u16(1); // Unicode BMP
+                out.u32(offset);
+                offset += f4.size();
+            }
+            if (!f12.empty()) {
+                out.u16(3);  // Windows
+                out.u16(10); // Unicode full repertoire
+                out.u32(offset);
+            }
+            out.bytes(f4);
+            out.bytes(f12);
+            return std::move(out.data);
+        }
+
+
+        cmap_t
+        parse_cmap(span<const byte> cmap,
+                   unsigned num_glyphs)
+        {
+            if (cmap.empty())
+                return {};
+
+            span<const byte> best;
+            int best_score = 0;
+            const unsigned num_subtables = get_u16(cmap, 2);
+            for (unsigned i = 0; i < num_subtables; ++i) {
+                const size_t rec = 4 + 8 * i;
+                const uint16_t platform = get_u16(cmap, rec);
+                const uint16_t encoding = get_u16(cmap, rec + 2);
+                const uint32_t offset   = get_u32(cmap, rec + 4);
+                if (offset >= cmap.size())
+                    continue;
+                auto sub = cmap.subspan(offset);
+                const uint16_t format = get_u16(sub, 0);
+                int score = 0;
+                if (format == 12 && (platform == 3 && encoding == 10))
+                    score = 4;
+                else if (format == 12 && platform == 0)
+                    score = 3;
+                else if (format == 4 && (platform == 3 && encoding == 1))
+                    score = 2;
+                else if (format == 4 && platform == 0)
+                    score = 1;
+                if (score > best_score) {
+                    best_score = score;
+                    best = sub;
+                }
+            }
+
+            cmap_t result;
+            if (best_score >= 3)
+                result = parse_cmap_format12(best, num_glyphs);
+            else if (best_score >= 1)
+                result = parse_cmap_format4(best, num_glyphs);
+
+            std::ranges::stable_sort(result, {}, &cmap_t::value_type::first);
+            auto [first, last] = std::ranges::unique(result, {}, &cmap_t::value_type::first);
+            result.erase(first, last);
+            return result;
+        }
+
+
+        // Appends the code point as UTF-8.
+        void
+        append_utf8(std::string& out,
+                    char32_t c)
+        {
+            if (c < 0x80) {
+                out += char(c);
+            } else if (c < 0x800) {
+                out += char(0xc0 | c >> 6);
+                out += char(0x80 | (c & 0x3f));
+            } else if (c < 0x10000) {
+                out += char(0xe0 | c >> 12);
+                out += char(0x80 | (c >> 6 & 0x3f));
+                out += char(0x80 | (c & 0x3f));
+            } else {
+                out += char(0xf0 | c >> 18);
+                out += char(0x80 | (c >> 12 & 0x3f));
+                out += char(0x80 | (c >> 6 & 0x3f));
+                out += char(0x80 | (c & 0x3f));
+            }
+        }
+
+
+        std::string
+        decode_utf16be(span<const byte> str)
+        {
+            std::string result;
+            for (size_t i = 0; i + 1 < str.size(); i += 2) {
+                char32_t c = get_u16(str, i);
+                if (c >= 0xd800 && c < 0xdc00 && i + 3 < str.size()) {
+                    const char32_t low = get_u16(str, i + 2);
+                    if (low >= 0xdc00 && low < 0xe000) {
+                        c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                        i += 2;
+                    }
+                }
+                append_utf8(result, c);
+            }
+            return result;
+        }
+
+
+        /*
+         * The typographic family (name ID 16) if there is one, otherwise the family (name ID
+         * 1). Windows English names are preferred, Mac Roman names are the last resort.
+         */
+        std::string
+        parse_family(span<const byte> name)
+        {
+            if (name.empty())
+                return {};
+            const unsigned count = get_u16(name, 2);
+            const size_t storage = get_u16(name, 4);
+            span<const byte> best;
+            bool best_utf16 = false;
+            int best_score = 0;
+            for (unsigned i = 0; i < count; ++i) {
+                const size_t rec = 6 + 12 * i;
+                const uint16_t platform = get_u16(name, rec);
+                const uint16_t encoding = get_u16(name, rec + 2);
+                const uint16_t language = get_u16(name, rec + 4);
+                const uint16_t name_id  = get_u16(name, rec + 6);
+                const uint16_t length   = get_u16(name, rec + 8);
+                const size_t offset     = storage + get_u16(name, rec + 10);
+                if (name_id != 1 && name_id != 16)
+                    continue;
+                if (offset > name.size() || length > name.size() - offset)
+                    continue;
+                int score = 0;
+                if (platform == 3 && (encoding == 1 || encoding == 10))
+                    score = language == 0x409 ? 4 : 3;
+                else if (platform == 0)
+                    score = 2;
+                else if (platform == 1 && encoding == 0)
+                    score = 1;
+                if (!score)
+                    continue;
+                if (name_id == 16)
+                    score += 4;
+                if (score > best_score) {
+                    best_score = score;
+                    best = name.subspan(offset, length);
+                    best_utf16 = platform != 1;
+                }
+            }
+            if (best_utf16)
+                return decode_utf16be(best);
+            // Mac Roman; only the ASCII part is kept.
+            std::string result;
+            for (auto b : best)
+                result += to_integer<uint8_t>(b) < 0x80 ? char(b) : '?';
+            return result;
+        }
+    } // namespace
+
+
+    font::font(span<const byte> data) :
+        data{data}
+    {
+        const uint32_t version = get_u32(data, 0);
+        if (version == make_tag("OTTO"))
+            throw error{"CFF fonts are not supported"};
+        if (version == make_tag("ttcf"))
+            throw error{"font collections are not supported"};
+        if (version != 0x00010000 && version != make_tag("true"))
+            throw error{"not a TrueType font"};
+
+        const unsigned num_tables = get_u16(data, 4);
+        for (unsigned i = 0; i < num_tables; ++i) {
+            const size_t rec = 12 + 16 * i;
+            const tag_t tag = get_u32(data, rec);
+            const uint32_t offset = get_u32(data, rec + 8);
+            const uint32_t length = get_u32(data, rec + 12);
+            if (offset > data.size() || length > data.size() - offset)
+                throw error{"table \"" + tag_name(tag) + "\" is out of bounds"};
+            records.push_back({tag, data.subspan(offset, length)});
+        }
+
+        for (auto tag : {tag_head, tag_hhea, tag_hmtx, tag_maxp, tag_loca, tag_glyf})
+            if (!has_table(tag))
+                throw error{"missing table \"" + tag_name(tag) + "\""};
+
+        auto head = table(tag_head);
+        em = get_u16(head, 18);
+        if (!em)
+            throw error{"unitsPerEm is zero"};
+        long_loca = get_i16(head, 50) != 0;
+        glyph_count = get_u16(table(tag_maxp), 4);
+        h_metrics = get_u16(table(tag_hhea), 34);
+        if (!h_metrics || h_metrics > glyph_count)
+            throw error{"bad numberOfHMetrics"};
+    }
+
+
+    span<const byte>
+    font::table(tag_t tag)
+        const noexcept
+    {
+        for (const auto& rec : records)
+            if (rec.tag == tag)
+                return rec.data;
+        return {};
+    }
+
+
+    bool
+    font::has_table(tag_t tag)
+        const noexcept
+    {
+        for (const auto& rec : records)
+            if (rec.tag == tag)
+                return true;
+        return false;
+    }
+
+
+    std::vector<tag_t>
+    font::table_tags()
+        const
+    {
+        std::vector<tag_t> result;
+        for (const auto& rec : records)
+            result.push_back(rec.tag);
+        return result;
+    }
+
+
+    cmap_t
+    font::cmap()
+        const
+    {
+        return parse_cmap(table(tag_cmap), glyph_count);
+    }
+
+
+    span<const byte>
+    font::glyph(unsigned id)
+        const
+    {
+        if (id >= glyph_count)
+            throw error{"glyph index out of range: " + to_string(id)};
+        auto loca = table(tag_loca);
+        uint32_t start;
+        uint32_t end;
+        if (long_loca) {
+            start = get_u32(loca, 4 * id);
+            end   = get_u32(loca, 4 * id + 4);
+        } else {
+            start = 2 * uint32_t{get_u16(loca, 2 * id)};
+            end   = 2 * uint32_t{get_u16(loca, 2 * id + 2)};
+        }
+        auto glyf = table(tag_glyf);
+        if (start > end || end > glyf.size())
+            throw error{"bad loca entry for glyph " + to_string(id)};
+        return glyf.subspan(start, end - start);
+    }
+
+
+    metric
+    font::get_metric(unsigned id)
+        const
+    {
+        auto hmtx = table(tag_hmtx);
+        if (id < h_metrics)
+            return { get_u16(hmtx, 4 * id), get_i16(hmtx, 4 * id + 2) };
+        return {
+            get_u16(hmtx, 4 * (h_metrics - 1)),
+            get_i16(hmtx, 4 * h_metrics + 2 * (id - h_metrics))
+        };
+    }
+
+
+    void
+    builder::add(tag_t tag, span<const byte> data)
+    {
+        tables.push_back({tag, {data}});
+    }
+
+
+    void
+    builder::add(tag_t tag, std::vector<byte>&& data)
+    {
+        storage.push_back(std::move(data));
+        add(tag, storage.back());
+    }
+
+
+    void
+    builder::append(span<const byte> data)
+    {
+        if (tables.empty())
+            throw error{"no table to append to"};
+        tables.back().parts.push_back(data);
+    }
+
+
+    void
+    builder::append(std::vector<byte>&& data)
+    {
+        storage.push_back(std::move(data));
+        append(storage.back());
+    }
+
+
+    size_t
+    builder::size()
+        const
+    {
+        size_t result = 12 + 16 * tables.size();
+        for (const auto& t : tables) {
+            size_t len = 0;
+            for (auto part : t.parts)
+                len += part.size();
+            result += align4(len);
+        }
+        return result;
+    }
+
+
+    void
+    builder::write(span<byte> output)
+        const
+    {
+        if (output.size() != size())
+            throw error{"bad output size"};
+
+        std::vector<const table_entry*> sorted;
+        for (const auto& t : tables)
+            sorted.push_back(&t);
+        std::ranges::sort(sorted, {}, &table_entry::tag);
+
+        const unsigned num_tables = sorted.size();
+        unsigned entry_selector = 0;
+        while ((2u << entry_selector) <= num_tables)
+            ++entry_selector;
+        const unsigned search_range = 16u << entry_selector;
+
+        std::ranges::fill(output, byte{0});
+        put_u32(output, 0, 0x00010000);
+        put_u16(output, 4, num_tables);
+        put_u16(output, 6, search_range);
+        put_u16(output, 8, entry_selector);
+        put_u16(output, 10, num_tables * 16 - search_range);
+
+        size_t offset = 12 + 16 * num_tables;
+        size_t head_offset = 0;
+        for (unsigned i = 0; i < num_tables; ++i) {
+            const auto& t = *sorted[i];
+            size_t len = 0;
+            for (auto part : t.parts) {
+                std::memcpy(output.data() + offset + len, part.data(), part.size());
+                len += part.size();
+            }
+            if (t.tag == tag_head) {
+                head_offset = offset;
+                put_u32(output, offset + 8, 0); // checkSumAdjustment
+            }
+
+            uint32_t checksum = 0;
+            for (size_t p = 0; p < align4(len); p += 4)
+                checksum += get_u32(output, offset + p);
+
+            const size_t rec = 12 + 16 * i;
+            put_u32(output, rec,      t.tag);
+            put_u32(output, rec + 4,  checksum);
+            put_u32(output, rec + 8,  offset);
+            put_u32(output, rec + 12, len);
+
+            offset += align4(len);
+        }
+
+        if (head_offset) {
+            uint32_t checksum = 0;
+            for (size_t p = 0; p < output.size(); p += 4)
+                checksum += get_u32(output, p);
+            put_u32(output, head_offset + 8, 0xb1b0afba - checksum);
+        }
+    }
+
+
+    std::vector<byte>
+    builder::write()
+        const
+    {
+        std::vector<byte> result(size());
+        write(result);
+        return result;
+    }
+
+
+    builder
+    merge(const font& first,
+          const font& second,
+          const merge_options& options,
+          merge_stats* stats)
+    {
+        auto in_range = [&options](char32_t c) -> bool
+        {
+            return c >= options.range_first && c <= options.range_last;
+        };
+
+        if (options.units_per_em && (options.units_per_em < 16 || options.units_per_em > 16384))
+            throw error{"unitsPerEm is out of range: " + to_string(options.units_per_em)};
+        const unsigned em = options.units_per_em ? options.units_per_em : first.units_per_em();
+        const bool rescale = em != first.units_per_em();
+
+        cmap_t map = first.cmap();
+        std::erase_if(map, [&in_range](const auto& entry) { return in_range(entry.first); });
+
+        glyph_importer importer{second, em, first.num_glyphs()};
+        cmap_t added;
+        for (auto [c, g] : second.cmap()) {
+            if (!in_range(c)) {
+                if (!options.fill_missing)
+                    continue;
+                auto it = std::ranges::lower_bound(map, c, {}, &cmap_t::value_type::first);
+                if (it != map.end() && it->first == c)
+                    continue;
+            }
+            added.emplace_back(c, importer.import(g));
+        }
+
+        map.insert(map.end(), added.begin(), added.end());
+        std::ranges::sort(map, {}, &cmap_t::value_type::first);
+
+        const unsigned old_count = first.num_glyphs();
+        const unsigned new_count = old_count + importer.order.size();
+
+        // The first font's glyphs keep their IDs; they're only converted when rescaled.
+        glyph_importer own{first, em, 0};
+        span<const byte> old_glyf = first.table(tag_glyf);
+        std::vector<byte> scaled_glyf;
+        std::vector<uint32_t> old_offsets;
+        std::vector<metric> old_metrics;
+        if (rescale) {
+            std::iota(own.new_ids.begin(), own.new_ids.end(), 0u);
+            for (unsigned id = 0; id < old_count; ++id) {
+                old_offsets.push_back(scaled_glyf.size());
+                bbox box;
+                auto data = own.convert(id, box);
+                scaled_glyf.insert(scaled_glyf.end(), data.begin(), data.end());
+                while (scaled_glyf.size() % 4)
+                    scaled_glyf.push_back(byte{0});
+                old_metrics.push_back(own.convert_metric(id, data.empty(), box));
+            }
+            old_glyf = scaled_glyf;
+        } else {
+            for (unsigned id = 0; id < old_count; ++id) {
+                old_offsets.push_back(first.glyph(id).data() - old_glyf.data());
+                old_metrics.push_back(first.get_metric(id));
+            }
+        }
+
+        // Convert the new glyphs.
+        const size_t glyf_base = align4(old_glyf.size());
+        std::vector<byte> new_glyf(glyf_base - old_glyf.size());
+        std::vector<uint32_t> new_offsets;
+        std::vector<metric> new_metrics;
+        bbox head_box{
+            own.scale(get_i16(first.table(tag_head), 36)),
+            own.scale(get_i16(first.table(tag_head), 38)),
+            own.scale(get_i16(first.table(tag_head), 40)),
+            own.scale(get_i16(first.table(tag_head), 42)),
+        };
+        auto hhea = copy_of(first.table(tag_hhea));
+        // ascender, descender, lineGap, minLeftSideBearing, minRightSideBearing,
+        // xMaxExtent, caretOffset
+        own.scale_fields(hhea, {4, 6, 8, 12, 14, 16, 22});
+        own.scale_unsigned_fields(hhea, {10}); // advanceWidthMax
+        uint16_t advance_max = get_u16(hhea, 10);
+        int16_t min_lsb      = get_i16(hhea, 12);
+        int16_t min_rsb      = get_i16(hhea, 14);
+        int16_t max_extent   = get_i16(hhea, 16);
+        for (auto id : importer.order) {
+            new_offsets.push_back(old_glyf.size() + new_glyf.size());
+            bbox box;
+            auto data = importer.convert(id, box);
+            new_glyf.insert(new_glyf.end(), data.begin(), data.end());
+            // Aligned on the offset in the whole table; empty glyphs need no padding.
+            while ((old_glyf.size() + new_glyf.size()) % 4)
+                new_glyf.push_back(byte{0});
+
+            const metric scaled = importer.convert_metric(id, data.empty(), box);
+            new_metrics.push_back(scaled);
+
+            advance_max = std::max(advance_max, scaled.advance);
+            if (!data.empty()) {
+                const int32_t width = box.x_max - box.x_min;
+                min_lsb    = std::min<int32_t>(min_lsb, scaled.lsb);
+                min_rsb    = std::min<int32_t>(min_rsb, scaled.advance - scaled.lsb - width);
+                max_extent = std::max<int32_t>(max_extent, scaled.lsb + width);
+                head_box.x_min = std::min(head_box.x_min, box.x_min);
+                head_box.y_min = std::min(head_box.y_min, box.y_min);
+                head_box.x_max = std::max(head_box.x_max, box.x_max);
+                head_box.y_max = std::max(head_box.y_max, box.y_max);
+            }
+        }
+        new_offsets.push_back(old_glyf.size() + new_glyf.size());
+
+        // loca, always in the long format.
+        byte_writer loca;
+        for (auto offset : old_offsets)
+            loca.u32(offset);
+        for (auto offset : new_offsets)
+            loca.u32(offset);
+
+        // hmtx, with a full metric for every glyph.
+        byte_writer hmtx;
+        for (auto m : old_metrics) {
+            hmtx.u16(m.advance);
+            hmtx.i16(m.lsb);
+        }
+        for (auto m : new_metrics) {
+            hmtx.u16(m.advance);
+            hmtx.i16(m.lsb);
+        }
+
+        put_u16(hhea, 10, advance_max);
+        put_u16(hhea, 12, min_lsb);
+        put_u16(hhea, 14, min_rsb);
+        put_u16(hhea, 16, max_extent);
+        put_u16(hhea, 34, new_count);
+
+        auto maxp = copy_of(first.table(tag_maxp));
+        put_u16(maxp, 4, new_count);
+        if (get_u32(maxp, 0) == 0x00010000 && maxp.size() >= 32) {
+            unsigned max_points     = get_u16(maxp, 6);
+            unsigned max_contours   = get_u16(maxp, 8);
+            unsigned max_c_points   = get_u16(maxp, 10);
+            unsigned max_c_contours = get_u16(maxp, 12);
+            unsigned max_elements   = get_u16(maxp, 28);
+            unsigned max_depth      = get_u16(maxp, 30);
+            for (const auto& info : importer.infos) {
+                if (info.components) {
+                    max_c_points   = std::max(max_c_points,   info.points);
+                    max_c_contours = std::max(max_c_contours, info.contours);
+                    max_elements   = std::max(max_elements,   info.components);
+                    max_depth      = std::max(max_depth,      info.depth);
+                } else {
+                    max_points   = std::max(max_points,   info.points);
+                    max_contours = std::max(max_contours, info.contours);
+                }
+            }
+            put_u16(maxp, 6,  std::min(max_points,     0xffffu));
+            put_u16(maxp, 8,  std::min(max_contours,   0xffffu));
+            put_u16(maxp, 10, std::min(max_c_points,   0xffffu));
+            put_u16(maxp, 12, std::min(max_c_contours, 0xffffu));
+            put_u16(maxp, 28, std::min(max_elements,   0xffffu));
+            put_u16(maxp, 30, std::min(max_depth,      0xffffu));
+        }
+
+        auto head = copy_of(first.table(tag_head));
+        put_u16(head, 18, em);
+        put_u16(head, 36, head_box.x_min);
+        put_u16(head, 38, head_box.y_min);
+        put_u16(head, 40, head_box.x_max);
+        put_u16(head, 42, head_box.y_max);
+        put_u16(head, 50, 1); // long loca
+
+        builder result;
+        for (auto tag : first.table_tags()) {
+            if (std::ranges::find(dropped_tags, tag) != std::end(dropped_tags))
+                continue;
+            if (rescale && std::ranges::find(unscaled_tags, tag) != std::end(unscaled_tags))
+                continue;
+
+            if (tag == tag_cmap)
+                result.add(tag, build_cmap(map));
+            else if (tag == tag_glyf) {
+                if (rescale)
+                    result.add(tag, std::move(scaled_glyf));
+                else
+                    result.add(tag, old_glyf);
+                result.append(std::move(new_glyf));
+            } else if (tag == tag_loca)
+                result.add(tag, std::move(loca.data));
+            else if (tag == tag_hmtx)
+                result.add(tag, std::move(hmtx.data));
+            else if (tag == tag_hhea)
+                result.add(tag, std::move(hhea));
+            else if (tag == tag_maxp)
+                result.add(tag, std::move(maxp));
+            else if (tag == tag_head)
+                result.add(tag, std::move(head));
+            else if (tag == tag_post) {
+                const auto old_post = first.table(tag_post);
+                // glyph names would need one entry per glyph, so drop them; a post table
+                // shorter than its 32-byte header is copied as it is
+                const bool has_names = old_post.size() >= 32
+                    && (get_u32(old_post, 0) == 0x00020000
+                        || get_u32(old_post, 0) == 0x00025000);
+                auto post = copy_of(has_names ? old_post.first(32) : old_post);
+                if (has_names)
+                    put_u32(post, 0, 0x00030000);
+                own.scale_fields(post, {8, 10}); // underlinePosition, underlineThickness
+                result.add(tag, std::move(post));
+            } else if (tag == tag_kern && rescale) {
+                auto kern = scale_kern(first.table(tag_kern), own);
+                if (!kern.empty())
+                    result.add(tag, std::move(kern));
+            } else if (tag == tag_os2) {
+                auto os2 = copy_of(first.table(tag_os2));
+                // xAvgCharWidth, subscript and superscript sizes and offsets, strikeout,
+                // typographic metrics, sxHeight, sCapHeight
+                own.scale_fields(os2, {2, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28,
+                                       68, 70, 72, 86, 88});
+                own.scale_unsigned_fields(os2, {74, 76}); // usWinAscent, usWinDescent
+                if (os2.size() >= 68 && !map.empty()) {
+                    put_u16(os2, 64, std::min<char32_t>(map.front().first, 0xffff));
+                    put_u16(os2, 66, std::min<char32_t>(map.back().first, 0xffff));
+                }
+                result.add(tag, std::move(os2));
+            } else
+                result.add(tag, first.table(tag));
+        }
+        if (!first.has_table(tag_cmap))
+            result.add(tag_cmap, build_cmap(map));
+
+        if (stats) {
+            stats->glyphs_added = importer.order.size();
+            stats->code_points_added = added.size();
+        }
+
+        return result;
+    }
+
+    info
+    read_info(const std::function<std::vector<byte>(uint32_t offset,
+                                                    uint32_t size)>& read,
+              char32_t range_first,
+              char32_t range_last)
+    {
+        const auto header = read(0, 12);
+        const uint32_t version = get_u32(header, 0);
+        if (version != 0x00010000 && version != make_tag("true"))
+            throw error{"not a TrueType font"};
+        const unsigned num_tables = get_u16(header, 4);
+        const auto dir = read(12, 16 * num_tables);
+
+        auto load = [&dir, num_tables, &read](tag_t tag) -> std::vector<byte>
+        {
+            for (unsigned i = 0; i < num_tables; ++i) {
+                const size_t rec = 16 * i;
+                if (get_u32(dir, rec) == tag)
+                    return read(get_u32(dir, rec + 8), get_u32(dir, rec + 12));
+            }
+            return {};
+        };
+
+        info result;
+        const auto maxp = load(tag_maxp);
+        if (maxp.empty())
+            throw error{"missing table \"maxp\""};
+        result.num_glyphs = get_u16(maxp, 4);
+        result.family = parse_family(load(tag_names));
+        const auto map = parse_cmap(load(tag_cmap), result.num_glyphs);
+        auto it = std::ranges::lower_bound(map, range_first, {}, &cmap_t::value_type::first);
+        result.covers_range = it != map.end() && it->first <= range_last;
+        return result;
+    }
+
+} // namespace sfnt
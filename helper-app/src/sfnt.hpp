@@ -0,0 +1,200 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SFNT_HPP
+#define SFNT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Just enough of the TrueType (sfnt) format to merge glyphs from one font into another, and
+// to describe a font in a listing.
+
+namespace sfnt {
+
+    struct error : std::runtime_error {
+
+        error(const char* msg);
+        error(const std::string& msg);
+
+    };
+
+
+    using tag_t = std::uint32_t;
+
+
+    constexpr
+    tag_t
+    make_tag(const char (&s)[5])
+        noexcept
+    {
+        return tag_t(std::uint8_t(s[0])) << 24
+            |  tag_t(std::uint8_t(s[1])) << 16
+            |  tag_t(std::uint8_t(s[2])) << 8
+            |  tag_t(std::uint8_t(s[3]));
+    }
+
+
+    // Sorted by code point.
+    using cmap_t = std::vector<std::pair<char32_t, std::uint16_t>>;
+
+
+    struct metric {
+        std::uint16_t advance;
+        std::int16_t lsb;
+    };
+
+
+    // Read-only view into a TrueType font; the data must outlive it.
+    class font {
+
+        struct table_record {
+            tag_t tag;
+            std::span<const std::byte> data;
+        };
+
+        std::span<const std::byte> data;
+        std::vector<table_record> records;
+
+        unsigned glyph_count = 0;
+        unsigned em = 0;
+        unsigned h_metrics = 0;
+        bool long_loca = false;
+
+    public:
+
+        explicit
+        font(std::span<const std::byte> data);
+
+
+        // Returns an empty span if the table doesn't exist.
+        std::span<const std::byte> table(tag_t tag) const noexcept;
+
+        bool has_table(tag_t tag) const noexcept;
+
+        std::vector<tag_t> table_tags() const;
+
+
+        unsigned
+        num_glyphs()
+            const noexcept
+        {
+            return glyph_count;
+        }
+
+
+        unsigned
+        units_per_em()
+            const noexcept
+        {
+            return em;
+        }
+
+
+        // The Unicode mapping, from the best cmap subtable available.
+        cmap_t cmap() const;
+
+        std::span<const std::byte> glyph(unsigned id) const;
+
+        metric get_metric(unsigned id) const;
+
+    };
+
+
+    struct merge_options {
+        // This range is cleared from the first font, then filled in by the second font.
+        char32_t range_first = 0xE000;
+        char32_t range_last  = 0xE099;
+        // Also copy every code point missing from the first font.
+        bool fill_missing = false;
+        // The em size of the output; 0 keeps the first font's. Any other size rescales the
+        // first font too, which strips its hinting, and drops the tables in font units
+        // that can't be rescaled (like GPOS).
+        unsigned units_per_em = 0;
+    };
+
+
+    struct merge_stats {
+        unsigned glyphs_added = 0;
+        unsigned code_points_added = 0;
+    };
+
+
+    // A font assembled from tables; unmodified tables point into the original font.
+    class builder {
+
+        struct table_entry {
+            tag_t tag;
+            std::vector<std::span<const std::byte>> parts;
+        };
+
+        std::vector<table_entry> tables;
+        std::vector<std::vector<std::byte>> storage;
+
+    public:
+
+        void add(tag_t tag, std::span<const std::byte> data);
+
+        void add(tag_t tag, std::vector<std::byte>&& data);
+
+        // Adds another chunk of data to the last table.
+        void append(std::span<const std::byte> data);
+
+        void append(std::vector<std::byte>&& data);
+
+
+        std::size_t size() const;
+
+        // The output must have exactly size() bytes.
+        void write(std::span<std::byte> output) const;
+
+        std::vector<std::byte> write() const;
+
+    };
+
+
+    /*
+     * Copies glyphs from the second font into the first: the range in the options is
+     * cleared from the first font, and filled in with glyphs from the second. Copied
+     * glyphs are scaled to the output's em size (by default, the first font's), and lose
+     * their hinting instructions.
+     */
+    builder
+    merge(const font& first,
+          const font& second,
+          const merge_options& options = {},
+          merge_stats* stats = nullptr);
+
+
+    struct info {
+        std::string family;     // UTF-8
+        unsigned num_glyphs = 0;
+        bool covers_range = false;
+    };
+
+
+    /*
+     * Only reads the table directory and the cmap, maxp and name tables, through the
+     * callback: read(offset, size) returns those bytes of the font, or throws.
+     */
+    info
+    read_info(const std::function<std::vector<std::byte>(std::uint32_t offset,
+                                                         std::uint32_t size)>& read,
+              char32_t range_first = 0xE000,
+              char32_t range_last  = 0xE099);
+
+} // namespace sfnt
+
+#endif
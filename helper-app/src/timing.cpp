@@ -0,0 +1,186 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "timing.hpp"
+
+
+using std::cout;
+using std::endl;
+
+
+namespace timing {
+
+    namespace {
+
+        struct record {
+            std::string file;
+            phase ph;
+            clock::duration time;
+            std::uintmax_t bytes;
+        };
+
+
+        std::mutex records_mutex;
+        std::vector<record> records;
+
+
+        const char* phase_names[] = {
+            "load",
+            "hash",
+            "apply",
+            "decode",
+            "compress",
+            "save",
+        };
+
+
+        const char*
+        to_string(phase ph)
+            noexcept
+        {
+            return phase_names[static_cast<unsigned>(ph)];
+        }
+
+
+        double
+        to_mb_per_s(std::uintmax_t bytes,
+                    clock::duration time)
+            noexcept
+        {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+            if (us <= 0)
+                return 0;
+            return static_cast<double>(bytes) / us;
+        }
+
+
+        std::intmax_t
+        to_ms(clock::duration time)
+            noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+        }
+
+    } // namespace
+
+
+    void
+    add(const std::string& file,
+        phase ph,
+        clock::duration time,
+        std::uintmax_t bytes)
+    {
+        std::lock_guard guard{records_mutex};
+        records.push_back({file, ph, time, bytes});
+    }
+
+
+    void
+    print_file(const std::string& file)
+    {
+        std::lock_guard guard{records_mutex};
+        const auto flags = cout.flags();
+        cout << std::fixed << std::setprecision(1) << " ";
+        for (const auto& rec : records)
+            if (rec.file == file)
+                cout << " " << to_string(rec.ph) << " "
+                     << to_mb_per_s(rec.bytes, rec.time) << " MB/s";
+        cout << endl;
+        cout.flags(flags);
+    }
+
+
+    void
+    print_summary()
+    {
+        std::lock_guard guard{records_mutex};
+        if (records.empty())
+            return;
+
+        cout << "Totals:" << endl;
+        const auto flags = cout.flags();
+        cout << std::fixed << std::setprecision(1);
+        for (unsigned p = 0; p < std::size(phase_names); ++p) {
+            clock::duration time{};
+            std::uintmax_t bytes = 0;
+            unsigned count = 0;
+            for (const auto& rec : records)
+                if (static_cast<unsigned>(rec.ph) == p) {
+                    time += rec.time;
+                    bytes += rec.bytes;
+                    ++count;
+                }
+            if (!count)
+                continue;
+            cout << "  " << std::setw(8) << std::left << phase_names[p] << std::right
+                 << std::setw(6) << (bytes / 1024) << " KiB in "
+                 << std::setw(5) << to_ms(time) << " ms ("
+                 << to_mb_per_s(bytes, time) << " MB/s)"
+                 << endl;
+        }
+        cout.flags(flags);
+    }
+
+
+    void
+    save_csv(const std::filesystem::path& csv_path,
+             const std::string& action)
+    {
+        std::lock_guard guard{records_mutex};
+        if (records.empty())
+            return;
+
+        const bool is_new = !exists(csv_path);
+        std::ofstream out{csv_path, std::ios::app};
+        if (!out) {
+            cout << "Could not write " << csv_path.filename() << endl;
+            return;
+        }
+        if (is_new)
+            out << "time,action,file,phase,bytes,us\n";
+
+        const auto now = std::time(nullptr);
+        for (const auto& rec : records)
+            out << now << ','
+                << action << ','
+                << '"' << rec.file << '"' << ','
+                << to_string(rec.ph) << ','
+                << rec.bytes << ','
+                << std::chrono::duration_cast<std::chrono::microseconds>(rec.time).count()
+                << '\n';
+
+        records.clear();
+    }
+
+
+    scope::scope(const std::string& file,
+                 phase ph,
+                 std::uintmax_t bytes) :
+        file{file},
+        ph{ph},
+        bytes{bytes},
+        start{clock::now()}
+    {}
+
+
+    scope::~scope()
+    {
+        try {
+            add(file, ph, clock::now() - start, bytes);
+        }
+        catch (...) {}
+    }
+
+} // namespace timing
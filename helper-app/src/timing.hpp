@@ -0,0 +1,83 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+
+// Records how long each phase of the work took, and how many bytes it processed.
+
+namespace timing {
+
+    using clock = std::chrono::steady_clock;
+
+
+    enum class phase {
+        load,
+        hash,
+        apply,
+        decode,
+        compress,
+        save,
+    };
+
+
+    // Thread-safe.
+    void add(const std::string& file,
+             phase ph,
+             clock::duration time,
+             std::uintmax_t bytes);
+
+
+    // Prints one line with the throughput of each phase recorded for this file.
+    void print_file(const std::string& file);
+
+    // Prints the totals for each phase.
+    void print_summary();
+
+    // Appends every record to a CSV file, then forgets them.
+    void save_csv(const std::filesystem::path& csv_path,
+                  const std::string& action);
+
+
+    class scope {
+
+        std::string file;
+        phase ph;
+        std::uintmax_t bytes;
+        clock::time_point start;
+
+    public:
+
+        scope(const std::string& file,
+              phase ph,
+              std::uintmax_t bytes = 0);
+
+        ~scope();
+
+        scope(const scope&) = delete;
+
+
+        // For when the size is only known at the end.
+        void
+        set_bytes(std::uintmax_t n)
+            noexcept
+        {
+            bytes = n;
+        }
+
+    };
+
+} // namespace timing
+
+#endif
@@ -0,0 +1,1028 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Implements the WOFF 1.0 and WOFF 2.0 File Format specifications from the W3C.
+
+#include <algorithm>            // min(), max()
+#include <array>
+#include <cstdlib>              // abs()
+#include <fstream>
+#include <memory>               // unique_ptr
+#include <optional>
+
+#include <zlib.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_BROTLIDEC
+#include <brotli/decode.h>
+#endif
+
+#include "sfnt.hpp"
+#include "woff.hpp"
+
+
+using std::byte;
+using std::int16_t;
+using std::size_t;
+using std::span;
+using std::to_string;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint8_t;
+
+using namespace std::literals;
+
+
+namespace woff {
+
+    error::error(const char* msg) :
+        std::runtime_error{"WOFF error: "s + msg}
+    {}
+
+
+    error::error(const std::string& msg) :
+        std::runtime_error{"WOFF error: "s + msg}
+    {}
+
+
+    namespace {
+
+        const uint32_t signature_woff  = sfnt::make_tag("wOFF");
+        const uint32_t signature_woff2 = sfnt::make_tag("wOF2");
+        const uint32_t flavor_truetype = 0x00010000;
+
+        const sfnt::tag_t tag_glyf = sfnt::make_tag("glyf");
+        const sfnt::tag_t tag_head = sfnt::make_tag("head");
+        const sfnt::tag_t tag_hhea = sfnt::make_tag("hhea");
+        const sfnt::tag_t tag_hmtx = sfnt::make_tag("hmtx");
+        const sfnt::tag_t tag_loca = sfnt::make_tag("loca");
+        const sfnt::tag_t tag_maxp = sfnt::make_tag("maxp");
+
+        // Refuse to allocate more than this, no matter what the headers say.
+        const size_t max_font_size = 64 * 1024 * 1024;
+
+        // How much of the compressed stream is read at a time.
+        const size_t chunk_size = 64 * 1024;
+
+
+        size_t
+        align4(size_t size)
+            noexcept
+        {
+            return (size + 3) & ~size_t{3};
+        }
+
+
+        // Bounds-checked big-endian reader.
+        struct reader {
+
+            span<const byte> data;
+            size_t pos = 0;
+
+
+            span<const byte>
+            bytes(size_t n)
+            {
+                if (n > data.size() - pos)
+                    throw error{"read past end of data, offset=" + to_string(pos)};
+                auto result = data.subspan(pos, n);
+                pos += n;
+                return result;
+            }
+
+
+            uint8_t
+            u8()
+            {
+                return std::to_integer<uint8_t>(bytes(1)[0]);
+            }
+
+
+            uint16_t
+            u16()
+            {
+                auto b = bytes(2);
+                return std::to_integer<uint16_t>(b[0]) << 8
+                    |  std::to_integer<uint16_t>(b[1]);
+            }
+
+
+            int16_t
+            i16()
+            {
+                return static_cast<int16_t>(u16());
+            }
+
+
+            uint32_t
+            u32()
+            {
+                uint32_t hi = u16();
+                return hi << 16 | u16();
+            }
+
+
+            // The "255UInt16" type from WOFF2.
+            uint16_t
+            u255()
+            {
+                uint8_t code = u8();
+                switch (code) {
+                case 253:
+                    return u16();
+                case 254:
+                    return u8() + 506;
+                case 255:
+                    return u8() + 253;
+                default:
+                    return code;
+                }
+            }
+
+
+            // The "UIntBase128" type from WOFF2.
+            uint32_t
+            base128()
+            {
+                uint32_t result = 0;
+                for (unsigned i = 0; i < 5; ++i) {
+                    uint8_t b = u8();
+                    if (i == 0 && b == 0x80)
+                        throw error{"UIntBase128 with leading zeros"};
+                    if (result & 0xfe000000)
+                        throw error{"UIntBase128 overflow"};
+                    result = result << 7 | (b & 0x7f);
+                    if (!(b & 0x80))
+                        return result;
+                }
+                throw error{"UIntBase128 is too long"};
+            }
+
+        };
+
+
+        struct writer {
+
+            std::vector<byte> data;
+
+
+            void
+            u8(uint8_t val)
+            {
+                data.push_back(byte{val});
+            }
+
+
+            void
+            u16(uint16_t val)
+            {
+                data.push_back(byte(val >> 8));
+                data.push_back(byte(val));
+            }
+
+
+            void
+            i16(int16_t val)
+            {
+                u16(static_cast<uint16_t>(val));
+            }
+
+
+            void
+            u32(uint32_t val)
+            {
+                u16(val >> 16);
+                u16(val);
+            }
+
+
+            void
+            bytes(span<const byte> blob)
+            {
+                data.insert(data.end(), blob.begin(), blob.end());
+            }
+
+
+            void
+            align4()
+            {
+                data.resize(woff::align4(data.size()));
+            }
+
+        };
+
+
+        void
+        put_u16(span<byte> data, size_t offset, uint16_t val)
+        {
+            data[offset]     = byte(val >> 8);
+            data[offset + 1] = byte(val);
+        }
+
+
+        void
+        put_u32(span<byte> data, size_t offset, uint32_t val)
+        {
+            put_u16(data, offset,     val >> 16);
+            put_u16(data, offset + 2, val);
+        }
+
+
+        uint32_t
+        get_u32(span<const byte> data, size_t offset)
+            noexcept
+        {
+            return std::to_integer<uint32_t>(data[offset]) << 24
+                |  std::to_integer<uint32_t>(data[offset + 1]) << 16
+                |  std::to_integer<uint32_t>(data[offset + 2]) << 8
+                |  std::to_integer<uint32_t>(data[offset + 3]);
+        }
+
+
+        class file_reader {
+
+            std::filebuf fb;
+
+        public:
+
+            std::uintmax_t size;
+
+
+            explicit
+            file_reader(const std::filesystem::path& file_path) :
+                size{file_size(file_path)}
+            {
+                if (!fb.open(file_path, std::ios::in | std::ios::binary))
+                    throw std::runtime_error{"unable to open for reading"};
+            }
+
+
+            void
+            read(std::uintmax_t offset,
+                 span<byte> dest)
+            {
+                if (offset > size || dest.size() > size - offset)
+                    throw error{"data past the end of the file"};
+                if (fb.pubseekoff(offset, std::ios::beg) == std::streampos(std::streamoff(-1)))
+                    throw std::runtime_error{"unable to seek in file"};
+                auto n = fb.sgetn(reinterpret_cast<char*>(dest.data()), dest.size());
+                if (n != static_cast<std::streamsize>(dest.size()))
+                    throw std::runtime_error{"error reading file"};
+            }
+
+
+            std::vector<byte>
+            read(std::uintmax_t offset,
+                 size_t count)
+            {
+                std::vector<byte> result(count);
+                read(offset, result);
+                return result;
+            }
+
+        };
+
+
+        // Writes the sfnt header for this many tables.
+        void
+        put_sfnt_header(span<byte> output,
+                        unsigned num_tables)
+        {
+            unsigned entry_selector = 0;
+            while ((2u << entry_selector) <= num_tables)
+                ++entry_selector;
+            const unsigned search_range = 16u << entry_selector;
+
+            put_u32(output, 0, flavor_truetype);
+            put_u16(output, 4, num_tables);
+            put_u16(output, 6, search_range);
+            put_u16(output, 8, entry_selector);
+            put_u16(output, 10, num_tables * 16 - search_range);
+        }
+
+
+        /*
+         * WOFF 1.0
+         *
+         * Each table is decompressed straight into its place in the output.
+         */
+        std::vector<byte>
+        decode_woff(file_reader& file,
+                    stats* st)
+        {
+            const size_t header_size = 44;
+            const size_t entry_size = 20;
+
+            auto header_data = file.read(0, header_size);
+            reader header{header_data};
+            header.u32(); // signature
+            const uint32_t flavor = header.u32();
+            const uint32_t length = header.u32();
+            const unsigned num_tables = header.u16();
+            header.u16(); // reserved
+
+            if (flavor != flavor_truetype)
+                throw error{"only TrueType fonts are supported"};
+            if (length != file.size)
+                throw error{"wrong file length in header"};
+            if (!num_tables)
+                throw error{"no tables"};
+
+            struct entry {
+                uint32_t tag;
+                uint32_t offset;
+                uint32_t comp_length;
+                uint32_t orig_length;
+                uint32_t orig_checksum;
+            };
+
+            auto dir_data = file.read(header_size, num_tables * entry_size);
+            reader dir{dir_data};
+            std::vector<entry> entries(num_tables);
+            size_t output_size = 12 + 16 * num_tables;
+            for (auto& e : entries) {
+                e.tag           = dir.u32();
+                e.offset        = dir.u32();
+                e.comp_length   = dir.u32();
+                e.orig_length   = dir.u32();
+                e.orig_checksum = dir.u32();
+                if (e.comp_length > e.orig_length)
+                    throw error{"table is larger when compressed"};
+                output_size += align4(e.orig_length);
+                if (output_size > max_font_size)
+                    throw error{"font is too large"};
+            }
+
+            std::vector<byte> output(output_size);
+            put_sfnt_header(output, num_tables);
+
+            std::vector<byte> comp_buf;
+            size_t offset = 12 + 16 * num_tables;
+            std::optional<size_t> head_offset;
+            for (unsigned i = 0; i < num_tables; ++i) {
+                const auto& e = entries[i];
+                span<byte> dest{output.data() + offset, e.orig_length};
+
+                if (e.comp_length == e.orig_length)
+                    file.read(e.offset, dest);
+                else {
+                    comp_buf.resize(e.comp_length);
+                    file.read(e.offset, comp_buf);
+                    uLongf dest_len = dest.size();
+                    int r = uncompress(reinterpret_cast<Bytef*>(dest.data()),
+                                       &dest_len,
+                                       reinterpret_cast<const Bytef*>(comp_buf.data()),
+                                       comp_buf.size());
+                    if (r != Z_OK || dest_len != dest.size())
+                        throw error{"bad zlib data in table " + to_string(i)};
+                }
+
+                const size_t rec = 12 + 16 * i;
+                put_u32(output, rec + 0, e.tag);
+                put_u32(output, rec + 4, e.orig_checksum);
+                put_u32(output, rec + 8, offset);
+                put_u32(output, rec + 12, e.orig_length);
+
+                if (e.tag == tag_head && e.orig_length >= 12)
+                    head_offset = offset;
+                offset += align4(e.orig_length);
+            }
+
+            // The tables might be in a different order than in the original font.
+            if (head_offset) {
+                put_u32(output, *head_offset + 8, 0);
+                uint32_t sum = 0;
+                for (size_t p = 0; p < output.size(); p += 4)
+                    sum += get_u32(output, p);
+                put_u32(output, *head_offset + 8, 0xb1b0afba - sum);
+            }
+
+            if (st)
+                st->num_tables = num_tables;
+            return output;
+        }
+
+
+#ifdef HAVE_BROTLIDEC
+
+        const std::array<const char*, 63> known_tags = {
+            "cmap", "head", "hhea", "hmtx", "maxp", "name", "OS/2", "post",
+            "cvt ", "fpgm", "glyf", "loca", "prep", "CFF ", "VORG", "EBDT",
+            "EBLC", "gasp", "hdmx", "kern", "LTSH", "PCLT", "VDMX", "vhea",
+            "vmtx", "BASE", "GDEF", "GPOS", "GSUB", "EBSC", "JSTF", "MATH",
+            "CBDT", "CBLC", "COLR", "CPAL", "SVG ", "sbix", "acnt", "avar",
+            "bdat", "bloc", "bsln", "cvar", "fdsc", "feat", "fmtx", "fvar",
+            "gvar", "hsty", "just", "lcar", "mort", "morx", "opbd", "prop",
+            "trak", "Zapf", "Silf", "Glat", "Gloc", "Feat", "Sill",
+        };
+
+
+        sfnt::tag_t
+        tag_from_chars(const char* s)
+            noexcept
+        {
+            return sfnt::tag_t(uint8_t(s[0])) << 24
+                |  sfnt::tag_t(uint8_t(s[1])) << 16
+                |  sfnt::tag_t(uint8_t(s[2])) << 8
+                |  sfnt::tag_t(uint8_t(s[3]));
+        }
+
+
+        struct brotli_deleter {
+            void
+            operator ()(BrotliDecoderState* state)
+                const noexcept
+            {
+                BrotliDecoderDestroyInstance(state);
+            }
+        };
+
+
+        // Decompresses the stream straight from the file, one chunk at a time.
+        std::vector<byte>
+        decompress_stream(file_reader& file,
+                          std::uintmax_t offset,
+                          size_t comp_size,
+                          size_t size)
+        {
+            std::unique_ptr<BrotliDecoderState, brotli_deleter>
+                state{BrotliDecoderCreateInstance(nullptr, nullptr, nullptr)};
+            if (!state)
+                throw std::bad_alloc{};
+
+            std::vector<byte> output(size);
+            std::vector<byte> chunk(std::min(chunk_size, comp_size));
+
+            size_t avail_in = 0;
+            const uint8_t* next_in = nullptr;
+            size_t avail_out = output.size();
+            uint8_t* next_out = reinterpret_cast<uint8_t*>(output.data());
+            size_t remaining = comp_size;
+
+            for (;;) {
+                if (!avail_in && remaining) {
+                    size_t n = std::min(remaining, chunk.size());
+                    file.read(offset, span{chunk.data(), n});
+                    offset += n;
+                    remaining -= n;
+                    avail_in = n;
+                    next_in = reinterpret_cast<const uint8_t*>(chunk.data());
+                }
+                auto r = BrotliDecoderDecompressStream(state.get(),
+                                                       &avail_in, &next_in,
+                                                       &avail_out, &next_out,
+                                                       nullptr);
+                if (r == BROTLI_DECODER_RESULT_SUCCESS)
+                    break;
+                if (r == BROTLI_DECODER_RESULT_ERROR)
+                    throw error{"bad Brotli data: "s
+                                + BrotliDecoderErrorString(BrotliDecoderGetErrorCode(state.get()))};
+                if (r == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT)
+                    throw error{"more table data than the directory says"};
+                if (r == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT && !remaining)
+                    throw error{"compressed stream is truncated"};
+            }
+            if (avail_out)
+                throw error{"less table data than the directory says"};
+
+            return output;
+        }
+
+
+        struct point {
+            int x;
+            int y;
+            bool on_curve;
+        };
+
+
+        struct bbox {
+            int16_t x_min;
+            int16_t y_min;
+            int16_t x_max;
+            int16_t y_max;
+        };
+
+
+        int
+        with_sign(unsigned flag,
+                  int base)
+            noexcept
+        {
+            return (flag & 1) ? base : -base;
+        }
+
+
+        // Reads one point encoded as a triplet; the flag also selects the format.
+        void
+        read_triplet(uint8_t flag,
+                     reader& glyphs,
+                     int& dx,
+                     int& dy)
+        {
+            flag &= 0x7f;
+            if (flag < 10) {
+                dx = 0;
+                dy = with_sign(flag, ((flag & 14) << 7) + glyphs.u8());
+            } else if (flag < 20) {
+                dx = with_sign(flag, (((flag - 10) & 14) << 7) + glyphs.u8());
+                dy = 0;
+            } else if (flag < 84) {
+                const unsigned b0 = flag - 20;
+                const unsigned b1 = glyphs.u8();
+                dx = with_sign(flag,      1 + (b0 & 0x30) + (b1 >> 4));
+                dy = with_sign(flag >> 1, 1 + ((b0 & 0x0c) << 2) + (b1 & 0x0f));
+            } else if (flag < 120) {
+                const unsigned b0 = flag - 84;
+                const unsigned b1 = glyphs.u8();
+                const unsigned b2 = glyphs.u8();
+                dx = with_sign(flag,      1 + ((b0 / 12) << 8) + b1);
+                dy = with_sign(flag >> 1, 1 + (((b0 % 12) >> 2) << 8) + b2);
+            } else if (flag < 124) {
+                const unsigned b1 = glyphs.u8();
+                const unsigned b2 = glyphs.u8();
+                const unsigned b3 = glyphs.u8();
+                dx = with_sign(flag,      (b1 << 4) + (b2 >> 4));
+                dy = with_sign(flag >> 1, ((b2 & 0x0f) << 8) + b3);
+            } else {
+                const unsigned b1 = glyphs.u8();
+                const unsigned b2 = glyphs.u8();
+                const unsigned b3 = glyphs.u8();
+                const unsigned b4 = glyphs.u8();
+                dx = with_sign(flag,      (b1 << 8) + b2);
+                dy = with_sign(flag >> 1, (b3 << 8) + b4);
+            }
+        }
+
+
+        // Encodes the flags and coordinates of a simple glyph, the way the glyf table has them.
+        void
+        write_points(writer& out,
+                     const std::vector<point>& points,
+                     bool overlap)
+        {
+            writer flags;
+            writer xs;
+            writer ys;
+            int last_flag = -1;
+            unsigned repeat = 0;
+            int last_x = 0;
+            int last_y = 0;
+
+            for (size_t i = 0; i < points.size(); ++i) {
+                const auto& p = points[i];
+                uint8_t flag = p.on_curve ? 0x01 : 0x00;
+                if (i == 0 && overlap)
+                    flag |= 0x40;
+
+                const int dx = p.x - last_x;
+                const int dy = p.y - last_y;
+                if (dx == 0)
+                    flag |= 0x10;
+                else if (dx > -256 && dx < 256) {
+                    flag |= 0x02 | (dx > 0 ? 0x10 : 0x00);
+                    xs.u8(std::abs(dx));
+                } else
+                    xs.i16(dx);
+                if (dy == 0)
+                    flag |= 0x20;
+                else if (dy > -256 && dy < 256) {
+                    flag |= 0x04 | (dy > 0 ? 0x20 : 0x00);
+                    ys.u8(std::abs(dy));
+                } else
+                    ys.i16(dy);
+
+                if (flag == last_flag && repeat != 255) {
+                    flags.data.back() |= byte{0x08};
+                    ++repeat;
+                } else {
+                    if (repeat)
+                        flags.u8(repeat);
+                    flags.u8(flag);
+                    repeat = 0;
+                }
+                last_flag = flag;
+                last_x = p.x;
+                last_y = p.y;
+            }
+            if (repeat)
+                flags.u8(repeat);
+
+            out.bytes(flags.data);
+            out.bytes(xs.data);
+            out.bytes(ys.data);
+        }
+
+
+        struct glyf_result {
+            std::vector<byte> glyf;
+            std::vector<byte> loca;
+            std::vector<int16_t> x_mins;
+        };
+
+
+        // Reverses the glyf transform, creating both glyf and loca.
+        glyf_result
+        reconstruct_glyf(span<const byte> data)
+        {
+            reader header{data};
+            header.u16(); // reserved
+            const uint16_t option_flags = header.u16();
+            const unsigned num_glyphs = header.u16();
+            const uint16_t index_format = header.u16();
+
+            std::array<span<const byte>, 7> streams;
+            size_t offset = 36;
+            for (auto& s : streams) {
+                uint32_t size = header.u32();
+                if (size > data.size() - offset)
+                    throw error{"glyf stream is larger than the table"};
+                s = data.subspan(offset, size);
+                offset += size;
+            }
+            reader n_contours_s{streams[0]};
+            reader n_points_s{streams[1]};
+            reader flags_s{streams[2]};
+            reader glyphs_s{streams[3]};
+            reader composites_s{streams[4]};
+            reader bbox_s{streams[5]};
+            reader instructions_s{streams[6]};
+
+            const auto bbox_bitmap = bbox_s.bytes(4 * ((num_glyphs + 31) / 32));
+            span<const byte> overlap_bitmap;
+            if (option_flags & 1) {
+                reader rest{data.subspan(offset)};
+                overlap_bitmap = rest.bytes((num_glyphs + 7) / 8);
+            }
+
+            auto bit_set = [](span<const byte> bitmap, unsigned i) -> bool
+            {
+                return std::to_integer<unsigned>(bitmap[i >> 3]) & (0x80 >> (i & 7));
+            };
+
+            glyf_result result;
+            result.x_mins.resize(num_glyphs);
+            std::vector<uint32_t> offsets(num_glyphs + 1);
+            writer out;
+            std::vector<uint16_t> end_points;
+            std::vector<point> points;
+
+            for (unsigned id = 0; id < num_glyphs; ++id) {
+                offsets[id] = out.data.size();
+                const int16_t n_contours = n_contours_s.i16();
+                const bool has_bbox = bit_set(bbox_bitmap, id);
+
+                if (n_contours == 0) {
+                    if (has_bbox)
+                        throw error{"empty glyph " + to_string(id) + " has a bounding box"};
+                    continue;
+                }
+
+                if (n_contours < 0) {
+                    if (n_contours != -1)
+                        throw error{"bad contour count in glyph " + to_string(id)};
+                    if (!has_bbox)
+                        throw error{"composite glyph " + to_string(id) + " has no bounding box"};
+
+                    const size_t start = composites_s.pos;
+                    bool have_instructions = false;
+                    for (;;) {
+                        const uint16_t flags = composites_s.u16();
+                        have_instructions |= flags & 0x0100;
+                        composites_s.bytes(2 + ((flags & 0x0001) ? 4 : 2));
+                        if (flags & 0x0008)
+                            composites_s.bytes(2);
+                        else if (flags & 0x0040)
+                            composites_s.bytes(4);
+                        else if (flags & 0x0080)
+                            composites_s.bytes(8);
+                        if (!(flags & 0x0020))
+                            break;
+                    }
+
+                    out.i16(-1);
+                    const auto box = bbox_s.bytes(8);
+                    out.bytes(box);
+                    out.bytes(composites_s.data.subspan(start, composites_s.pos - start));
+                    if (have_instructions) {
+                        const uint16_t length = glyphs_s.u255();
+                        out.u16(length);
+                        out.bytes(instructions_s.bytes(length));
+                    }
+                    result.x_mins[id] = reader{box}.i16();
+                    out.align4();
+                    continue;
+                }
+
+                end_points.clear();
+                unsigned total = 0;
+                for (int c = 0; c < n_contours; ++c) {
+                    const unsigned n = n_points_s.u255();
+                    if (!n)
+                        throw error{"empty contour in glyph " + to_string(id)};
+                    total += n;
+                    if (total > 0xffff)
+                        throw error{"too many points in glyph " + to_string(id)};
+                    end_points.push_back(total - 1);
+                }
+
+                points.clear();
+                int x = 0;
+                int y = 0;
+                for (unsigned p = 0; p < total; ++p) {
+                    const uint8_t flag = flags_s.u8();
+                    int dx, dy;
+                    read_triplet(flag, glyphs_s, dx, dy);
+                    x += dx;
+                    y += dy;
+                    points.push_back({x, y, !(flag & 0x80)});
+                }
+
+                const uint16_t instructions_length = glyphs_s.u255();
+                const auto instructions = instructions_s.bytes(instructions_length);
+
+                bbox box;
+                if (has_bbox) {
+                    box.x_min = bbox_s.i16();
+                    box.y_min = bbox_s.i16();
+                    box.x_max = bbox_s.i16();
+                    box.y_max = bbox_s.i16();
+                } else {
+                    int x_min = points[0].x;
+                    int y_min = points[0].y;
+                    int x_max = x_min;
+                    int y_max = y_min;
+                    for (const auto& p : points) {
+                        x_min = std::min(x_min, p.x);
+                        y_min = std::min(y_min, p.y);
+                        x_max = std::max(x_max, p.x);
+                        y_max = std::max(y_max, p.y);
+                    }
+                    box = { int16_t(x_min), int16_t(y_min), int16_t(x_max), int16_t(y_max) };
+                }
+
+                out.i16(n_contours);
+                out.i16(box.x_min);
+                out.i16(box.y_min);
+                out.i16(box.x_max);
+                out.i16(box.y_max);
+                for (auto e : end_points)
+                    out.u16(e);
+                out.u16(instructions_length);
+                out.bytes(instructions);
+                write_points(out,
+                             points,
+                             !overlap_bitmap.empty() && bit_set(overlap_bitmap, id));
+                result.x_mins[id] = box.x_min;
+                out.align4();
+            }
+            offsets[num_glyphs] = out.data.size();
+            result.glyf = std::move(out.data);
+
+            writer loca;
+            for (auto o : offsets) {
+                if (index_format)
+                    loca.u32(o);
+                else {
+                    if (o / 2 > 0xffff)
+                        throw error{"glyf table is too large for a short loca"};
+                    loca.u16(o / 2);
+                }
+            }
+            result.loca = std::move(loca.data);
+
+            return result;
+        }
+
+
+        // Reverses the hmtx transform: missing side bearings are the glyphs' x_min.
+        std::vector<byte>
+        reconstruct_hmtx(span<const byte> data,
+                         const std::vector<int16_t>& x_mins,
+                         unsigned num_h_metrics)
+        {
+            const unsigned num_glyphs = x_mins.size();
+            if (!num_h_metrics || num_h_metrics > num_glyphs)
+                throw error{"bad numberOfHMetrics"};
+
+            reader in{data};
+            const uint8_t flags = in.u8();
+            if (flags & 0xfc)
+                throw error{"bad hmtx transform flags"};
+
+            std::vector<uint16_t> advances(num_h_metrics);
+            for (auto& a : advances)
+                a = in.u16();
+
+            std::vector<int16_t> lsbs(num_glyphs);
+            for (unsigned i = 0; i < num_glyphs; ++i) {
+                const bool proportional = i < num_h_metrics;
+                const bool derived = proportional ? (flags & 1) : (flags & 2);
+                lsbs[i] = derived ? x_mins[i] : in.i16();
+            }
+
+            writer out;
+            for (unsigned i = 0; i < num_glyphs; ++i) {
+                if (i < num_h_metrics)
+                    out.u16(advances[i]);
+                out.i16(lsbs[i]);
+            }
+            return std::move(out.data);
+        }
+
+
+        /*
+         * WOFF 2.0
+         *
+         * All tables are decompressed together, then the glyf, loca and hmtx tables are
+         * transformed back; the output gets new checksums.
+         */
+        std::vector<byte>
+        decode_woff2(file_reader& file,
+                     stats* st)
+        {
+            const size_t header_size = 48;
+
+            auto header_data = file.read(0, header_size);
+            reader header{header_data};
+            header.u32(); // signature
+            const uint32_t flavor = header.u32();
+            const uint32_t length = header.u32();
+            const unsigned num_tables = header.u16();
+            header.u16(); // reserved
+            header.u32(); // totalSfntSize
+            const uint32_t total_compressed_size = header.u32();
+
+            if (flavor != flavor_truetype)
+                throw error{"only TrueType fonts are supported"};
+            if (length != file.size)
+                throw error{"wrong file length in header"};
+            if (!num_tables)
+                throw error{"no tables"};
+
+            struct entry {
+                sfnt::tag_t tag;
+                bool transformed;
+                uint32_t orig_length;
+                span<const byte> data;
+            };
+
+            // Each directory entry has at most 1 + 4 + 5 + 5 bytes.
+            const size_t max_dir_size = std::min<std::uintmax_t>(num_tables * 15,
+                                                                  file.size - header_size);
+            auto dir_data = file.read(header_size, max_dir_size);
+            reader dir{dir_data};
+            std::vector<entry> entries(num_tables);
+            std::vector<uint32_t> lengths(num_tables);
+            size_t total_size = 0;
+            for (unsigned i = 0; i < num_tables; ++i) {
+                auto& e = entries[i];
+                const uint8_t flags = dir.u8();
+                const unsigned tag_index = flags & 0x3f;
+                e.tag = tag_index == 63 ? dir.u32() : tag_from_chars(known_tags[tag_index]);
+                const unsigned version = flags >> 6;
+                e.orig_length = dir.base128();
+                if (e.tag == tag_glyf || e.tag == tag_loca)
+                    e.transformed = version == 0;
+                else
+                    e.transformed = version != 0;
+                lengths[i] = e.transformed ? dir.base128() : e.orig_length;
+                total_size += lengths[i];
+                if (total_size > max_font_size)
+                    throw error{"font is too large"};
+            }
+
+            auto tables = decompress_stream(file,
+                                            header_size + dir.pos,
+                                            total_compressed_size,
+                                            total_size);
+            size_t offset = 0;
+            for (unsigned i = 0; i < num_tables; ++i) {
+                entries[i].data = span{tables}.subspan(offset, lengths[i]);
+                offset += lengths[i];
+            }
+
+            auto find = [&entries](sfnt::tag_t tag) -> entry*
+            {
+                for (auto& e : entries)
+                    if (e.tag == tag)
+                        return &e;
+                return nullptr;
+            };
+
+            entry* glyf = find(tag_glyf);
+            entry* loca = find(tag_loca);
+            if (!glyf || !loca)
+                throw error{"only TrueType fonts are supported"};
+            if (glyf->transformed != loca->transformed)
+                throw error{"glyf and loca must be transformed together"};
+            if (loca->transformed && !loca->data.empty())
+                throw error{"transformed loca must be empty"};
+
+            sfnt::builder output;
+            glyf_result glyphs;
+            if (glyf->transformed)
+                glyphs = reconstruct_glyf(glyf->data);
+
+            for (const auto& e : entries) {
+                if (e.tag == tag_glyf && e.transformed)
+                    output.add(e.tag, std::move(glyphs.glyf));
+                else if (e.tag == tag_loca && e.transformed)
+                    output.add(e.tag, std::move(glyphs.loca));
+                else if (e.tag == tag_hmtx && e.transformed) {
+                    if (!glyf->transformed)
+                        throw error{"hmtx can only be transformed along with glyf"};
+                    const entry* hhea = find(tag_hhea);
+                    if (!hhea)
+                        throw error{"no hhea table"};
+                    const unsigned num_h_metrics = reader{hhea->data, 34}.u16();
+                    output.add(e.tag, reconstruct_hmtx(e.data, glyphs.x_mins, num_h_metrics));
+                } else if (e.transformed)
+                    throw error{"unknown transform for table " + to_string(&e - entries.data())};
+                else
+                    output.add(e.tag, e.data);
+            }
+
+            if (!find(tag_head) || !find(tag_maxp))
+                throw error{"missing head or maxp table"};
+
+            if (st)
+                st->num_tables = num_tables;
+            return output.write();
+        }
+
+#endif // HAVE_BROTLIDEC
+
+    } // namespace
+
+
+    format
+    detect(span<const byte> data)
+        noexcept
+    {
+        if (data.size() < 4)
+            return format::unknown;
+        const uint32_t sig = std::to_integer<uint32_t>(data[0]) << 24
+                           | std::to_integer<uint32_t>(data[1]) << 16
+                           | std::to_integer<uint32_t>(data[2]) << 8
+                           | std::to_integer<uint32_t>(data[3]);
+        if (sig == signature_woff)
+            return format::woff;
+        if (sig == signature_woff2)
+            return format::woff2;
+        return format::unknown;
+    }
+
+
+    bool
+    woff2_supported()
+        noexcept
+    {
+#ifdef HAVE_BROTLIDEC
+        return true;
+#else
+        return false;
+#endif
+    }
+
+
+    std::vector<byte>
+    decode_file(const std::filesystem::path& file_path,
+                stats* st)
+    {
+        file_reader file{file_path};
+        std::array<byte, 4> signature;
+        file.read(0, signature);
+
+        std::vector<byte> result;
+        switch (detect(signature)) {
+        case format::woff:
+            result = decode_woff(file, st);
+            break;
+        case format::woff2:
+#ifdef HAVE_BROTLIDEC
+            result = decode_woff2(file, st);
+            break;
+#else
+            throw error{"WOFF2 support was not built in (Brotli is missing)"};
+#endif
+        default:
+            throw error{"not a WOFF or WOFF2 file"};
+        }
+
+        if (st) {
+            st->input_size = file.size;
+            st->output_size = result.size();
+        }
+        return result;
+    }
+
+} // namespace woff
@@ -0,0 +1,72 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef WOFF_HPP
+#define WOFF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/*
+ * Web fonts (WOFF and WOFF2), decoded back into plain TrueType fonts.
+ *
+ * WOFF compresses each table with zlib. WOFF2 compresses all tables together with
+ * Brotli, after transforming the glyf, loca and hmtx tables; decoding it needs the
+ * Brotli library to be available at build time.
+ */
+
+namespace woff {
+
+    struct error : std::runtime_error {
+
+        error(const char* msg);
+        error(const std::string& msg);
+
+    };
+
+
+    enum class format {
+        unknown,
+        woff,
+        woff2,
+    };
+
+
+    // Looks at the signature in the first 4 bytes.
+    format detect(std::span<const std::byte> data) noexcept;
+
+
+    // False when built without Brotli.
+    bool woff2_supported() noexcept;
+
+
+    struct stats {
+        std::uintmax_t input_size = 0;
+        std::uintmax_t output_size = 0;
+        unsigned num_tables = 0;
+    };
+
+
+    /*
+     * The file is read in pieces. Besides the output, only one compressed table (WOFF),
+     * or all the uncompressed tables before they're transformed back (WOFF2), are kept in
+     * memory.
+     */
+    std::vector<std::byte>
+    decode_file(const std::filesystem::path& file_path,
+                stats* st = nullptr);
+
+} // namespace woff
+
+#endif
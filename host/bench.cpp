@@ -0,0 +1,431 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Stress benchmark for the font loading and the OSGetSharedData() hook, built for the host
+ * with a fake coreinit:
+ *
+ *   - every scenario is a font config, loaded from a temporary directory that mimics the
+ *     SD card;
+ *
+ *   - "init" is update_font_sets() with nothing loaded yet, "reuse" is the same fonts
+ *     shuffled around the slots, so nothing needs to be read again;
+ *
+ *   - the hook is called from many threads at once, while another thread keeps
+ *     publishing new snapshots, like the menu does when it closes.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>              // atoi(), mkdtemp()
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <coreinit/thread.h>
+#include <coreinit/title.h>
+
+#include "fake.hpp"
+#include "font_heap.hpp"
+#include "font_sets.hpp"
+#include "shared_data.hpp"
+
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::filesystem::path;
+
+using clock_type = std::chrono::steady_clock;
+
+
+namespace {
+
+    const char* fonts_dir = "fs:/vol/external01/wiiu/fonts";
+
+    const std::uint64_t settings_id = 0x0005001010047000;
+    const std::uint64_t game_a_id   = 0x0005000010101c00;
+    const std::uint64_t game_b_id   = 0x000500001010ed00;
+
+    // Same name the on-screen keyboard thread has in the Wii U Menu.
+    const char* swkbd_thread_name = "MenSwkbdCalculator_Create";
+
+
+    struct options {
+        unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+        unsigned calls = 1'000'000;
+        bool verbose = false;
+    };
+
+
+    void
+    usage(const char* prog)
+    {
+        cout << "Usage:\n"
+             << "  " << prog << " [-j threads] [-n calls] [-v]\n"
+             << "\n"
+             << "  -j  threads calling the hook at once (default: one per core)\n"
+             << "  -n  hook calls per thread, per scenario (default: 1000000)\n"
+             << "  -v  show the plugin's log\n";
+    }
+
+
+    // The SD card layout, created under a temporary directory that becomes the current one.
+    class temp_sd_card {
+
+        path root;
+        path old_cwd;
+
+    public:
+
+        temp_sd_card()
+        {
+            std::string tmpl = (std::filesystem::temp_directory_path()
+                                / "font-bench-XXXXXX").string();
+            if (!mkdtemp(tmpl.data()))
+                throw std::runtime_error{"cannot create temporary directory"};
+            root = tmpl;
+            old_cwd = std::filesystem::current_path();
+            std::filesystem::current_path(root);
+            std::filesystem::create_directories(path{fonts_dir} / "cache");
+        }
+
+
+        ~temp_sd_card()
+        {
+            std::error_code ec;
+            std::filesystem::current_path(old_cwd, ec);
+            std::filesystem::remove_all(root, ec);
+        }
+
+
+        // Only the TTF magic matters to the loader.
+        static
+        std::string
+        add_font(const std::string& name,
+                 std::size_t size)
+        {
+            std::string font_path = std::string{fonts_dir} + "/" + name;
+            std::vector<char> content(size);
+            std::minstd_rand rng(size);
+            std::ranges::generate(content, [&rng] { return char(rng()); });
+            content[0] = 0x00;
+            content[1] = 0x01;
+            content[2] = 0x00;
+            content[3] = 0x00;
+            std::ofstream out{font_path, std::ios::binary};
+            out.write(content.data(), content.size());
+            if (!out)
+                throw std::runtime_error{"cannot write " + font_path};
+            return font_path;
+        }
+
+    };
+
+
+    struct scenario {
+        std::string name;
+        font_config config;
+        std::uint64_t title;
+    };
+
+
+    font_config::paths_t
+    all_slots(const std::string& font_path)
+    {
+        return { font_path, font_path, font_path, font_path };
+    }
+
+
+    std::vector<scenario>
+    make_scenarios()
+    {
+        const auto f256k = temp_sd_card::add_font("f256k.ttf", 256 * 1024);
+        const auto f512k = temp_sd_card::add_font("f512k.ttf", 512 * 1024);
+        const auto f1m   = temp_sd_card::add_font("f1m.ttf",   1 * 1024 * 1024);
+        const auto f2m   = temp_sd_card::add_font("f2m.ttf",   2 * 1024 * 1024);
+        const auto f4m   = temp_sd_card::add_font("f4m.ttf",   4 * 1024 * 1024);
+        const auto f8m   = temp_sd_card::add_font("f8m.ttf",   8 * 1024 * 1024);
+
+        font_config base{};
+        base.enabled = true;
+        base.only_menu = false;
+        base.merge_pua = false;
+
+        std::vector<scenario> result;
+
+        {
+            font_config c = base;
+            c.enabled = false;
+            result.push_back({"disabled", c, wii_u_menu_id});
+        }
+        {
+            font_config c = base;
+            c.paths = all_slots(f4m);
+            result.push_back({"one font", c, wii_u_menu_id});
+        }
+        {
+            font_config c = base;
+            c.paths = { f1m, f2m, f4m, f8m };
+            result.push_back({"four fonts", c, wii_u_menu_id});
+        }
+        {
+            font_config c = base;
+            c.paths = all_slots(f4m);
+            c.profiles[0] = { true, wii_u_menu_id, all_slots(f1m) };
+            c.profiles[1] = { true, settings_id,   all_slots(f2m) };
+            c.profiles[2] = { true, game_a_id,     { f256k, f256k, f512k, f256k } };
+            c.profiles[3] = { true, game_b_id,     all_slots(f8m) };
+            result.push_back({"profiles", c, game_a_id});
+        }
+        {
+            font_config c = base;
+            c.only_menu = true;
+            c.paths = all_slots(f4m);
+            result.push_back({"only menu, game", c, game_b_id});
+        }
+
+        return result;
+    }
+
+
+    // The same fonts, each moved to the next slot.
+    font_config
+    shuffled(font_config config)
+    {
+        std::ranges::rotate(config.paths, config.paths.begin() + 1);
+        for (auto& p : config.profiles)
+            std::ranges::rotate(p.paths, p.paths.begin() + 1);
+        return config;
+    }
+
+
+    // Same as the hook in main.cpp, with the fake OSGetSharedData() as the real function.
+    BOOL
+    hooked_OSGetSharedData(OSSharedDataType type,
+                           std::uint32_t unused,
+                           void** buf,
+                           std::uint32_t* size)
+    {
+        if (replace_shared_data(type, buf, size))
+            return true;
+        return OSGetSharedData(type, unused, buf, size);
+    }
+
+
+    struct hook_result {
+        double mean_ns;
+        std::uint64_t p50_ns;
+        std::uint64_t p99_ns;
+        std::uint64_t max_ns;
+        unsigned custom_percent;
+        unsigned snapshots;
+    };
+
+
+    double
+    elapsed_ms(clock_type::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    }
+
+
+    /*
+     * Every thread asks for all font types, plus one that isn't a font. One of them is
+     * named like the on-screen keyboard, to go through the skip_swkbd check. Only every
+     * 16th call is timed on its own; the mean comes from the whole loop.
+     */
+    hook_result
+    stress_hook(const options& opts,
+                std::uint64_t title)
+    {
+        const OSSharedDataType types[] = {
+            OS_SHAREDDATATYPE_FONT_STANDARD,
+            OS_SHAREDDATATYPE_FONT_CHINESE,
+            OS_SHAREDDATATYPE_FONT_KOREAN,
+            OS_SHAREDDATATYPE_FONT_TAIWANESE,
+            OSSharedDataType(4),
+        };
+
+        std::atomic_bool start = false;
+        std::atomic_uint running = opts.threads;
+        std::vector<std::vector<std::uint64_t>> samples(opts.threads);
+        std::vector<double> loop_ns(opts.threads);
+        std::vector<std::uint64_t> customs(opts.threads);
+
+        auto caller = [&](unsigned idx)
+        {
+            std::string name = idx == 1 ? swkbd_thread_name : "caller " + std::to_string(idx);
+            OSSetThreadName(OSGetCurrentThread(), name.c_str());
+            auto& my_samples = samples[idx];
+            my_samples.reserve(opts.calls / 16 + 1);
+            std::uint64_t custom = 0;
+
+            while (!start)
+                std::this_thread::yield();
+
+            const auto t0 = clock_type::now();
+            for (unsigned i = 0; i < opts.calls; ++i) {
+                void* buf = nullptr;
+                std::uint32_t size = 0;
+                const auto type = types[i % std::size(types)];
+                if (i % 16) {
+                    hooked_OSGetSharedData(type, 0, &buf, &size);
+                } else {
+                    const auto c0 = clock_type::now();
+                    hooked_OSGetSharedData(type, 0, &buf, &size);
+                    const auto c1 = clock_type::now();
+                    my_samples.push_back(std::chrono::nanoseconds(c1 - c0).count());
+                }
+                custom += size > 64;
+            }
+            loop_ns[idx] = std::chrono::duration<double, std::nano>(clock_type::now() - t0)
+                .count();
+            customs[idx] = custom;
+            --running;
+        };
+
+        std::vector<std::jthread> callers;
+        for (unsigned idx = 0; idx < opts.threads; ++idx)
+            callers.emplace_back(caller, idx);
+
+        // Keeps replacing the snapshot under the callers' feet.
+        unsigned snapshots = 0;
+        start = true;
+        while (running) {
+            activate_font_set(title);
+            ++snapshots;
+            std::this_thread::sleep_for(std::chrono::microseconds{100});
+        }
+        callers.clear();
+
+        std::vector<std::uint64_t> all;
+        for (auto& s : samples)
+            all.insert(all.end(), s.begin(), s.end());
+        std::ranges::sort(all);
+
+        hook_result result{};
+        double total_ns = 0;
+        for (auto ns : loop_ns)
+            total_ns += ns;
+        std::uint64_t total_custom = 0;
+        for (auto c : customs)
+            total_custom += c;
+        const double total_calls = double(opts.calls) * opts.threads;
+        result.mean_ns = total_ns / total_calls;
+        if (!all.empty()) {
+            result.p50_ns = all[all.size() / 2];
+            result.p99_ns = all[all.size() * 99 / 100];
+            result.max_ns = all.back();
+        }
+        result.custom_percent = unsigned(100 * total_custom / total_calls);
+        result.snapshots = snapshots;
+        return result;
+    }
+
+
+    void
+    reset()
+    {
+        font_config off{};
+        update_font_sets(off);
+        release_font_sets();
+    }
+
+
+    void
+    run(const scenario& s,
+        const options& opts)
+    {
+        reset();
+
+        auto t0 = clock_type::now();
+        update_font_sets(s.config);
+        const double init_ms = elapsed_ms(t0);
+        const auto used = font_heap::get_stats().used;
+
+        t0 = clock_type::now();
+        update_font_sets(shuffled(s.config));
+        const double reuse_ms = elapsed_ms(t0);
+
+        fake::set_title_id(s.title);
+        t0 = clock_type::now();
+        activate_font_set(OSGetTitleID());
+        const double activate_us = elapsed_ms(t0) * 1000;
+
+        const auto hook = stress_hook(opts, OSGetTitleID());
+
+        cout << std::left << std::setw(16) << s.name << std::right
+             << std::fixed << std::setprecision(2)
+             << std::setw(8) << double(used) / (1024 * 1024)
+             << std::setw(9) << init_ms
+             << std::setw(9) << reuse_ms
+             << std::setw(10) << activate_us
+             << std::setprecision(1)
+             << std::setw(9) << hook.mean_ns
+             << std::setw(8) << hook.p50_ns
+             << std::setw(8) << hook.p99_ns
+             << std::setw(9) << hook.max_ns
+             << std::setw(8) << hook.custom_percent
+             << std::setw(7) << hook.snapshots
+             << endl;
+
+        release_font_sets();
+    }
+
+} // namespace
+
+
+int
+main(int argc, char* argv[])
+try {
+    options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            opts.threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "-n" && i + 1 < argc)
+            opts.calls = std::max(16, std::atoi(argv[++i]));
+        else if (arg == "-v")
+            opts.verbose = true;
+        else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    fake::set_logging(opts.verbose);
+    font_heap::configure(font_heap::kind::plugin, 64 * 1024 * 1024);
+
+    temp_sd_card sd;
+    const auto scenarios = make_scenarios();
+
+    cout << opts.threads << " threads, " << opts.calls << " hook calls each\n"
+         << "                    MiB  init ms reuse ms  activ us  hook ns  p50 ns  p99 ns"
+            "   max ns custom% snaps"
+         << endl;
+    for (const auto& s : scenarios)
+        run(s, opts);
+
+    reset();
+}
+catch (std::exception& e) {
+    cerr << "ERROR: " << e.what() << endl;
+    return 1;
+}
@@ -0,0 +1,28 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FAKE_HPP
+#define FAKE_HPP
+
+#include <cstdint>
+
+
+// Knobs for the fake coreinit and libwupsxx, that only the host harness uses.
+
+namespace fake {
+
+    // What OSGetTitleID() returns.
+    void set_title_id(std::uint64_t title) noexcept;
+
+
+    // When false, wups::logger::printf() prints nothing.
+    void set_logging(bool enabled) noexcept;
+
+} // namespace fake
+
+#endif
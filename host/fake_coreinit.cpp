@@ -0,0 +1,189 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>              // aligned_alloc(), free()
+#include <mutex>
+#include <unordered_map>
+
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/memexpheap.h>
+#include <coreinit/memory.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <coreinit/title.h>
+
+#include "fake.hpp"
+
+
+namespace {
+
+    std::atomic<std::uint64_t> title_id = 0;
+
+    thread_local OSThread current_thread;
+
+
+    void*
+    allocate(std::uint32_t size,
+             int alignment)
+    {
+        const std::size_t align = alignment > 0 ? alignment : 4;
+        return std::aligned_alloc(align, (size + align - 1) / align * align);
+    }
+
+} // namespace
+
+
+struct MEMHeapHeader {
+    std::mutex mutex;
+    std::uint32_t free;
+    std::unordered_map<void*, std::uint32_t> blocks;
+};
+
+
+namespace fake {
+
+    void
+    set_title_id(std::uint64_t title)
+        noexcept
+    {
+        title_id = title;
+    }
+
+} // namespace fake
+
+
+BOOL
+OSGetSharedData(OSSharedDataType type,
+                std::uint32_t,
+                void** buf,
+                std::uint32_t* size)
+{
+    static const char placeholders[4][16] = {
+        "system font Cn", "system font Kr", "system font Std", "system font Tw"
+    };
+    if (type > OS_SHAREDDATATYPE_FONT_TAIWANESE)
+        return false;
+    *buf  = const_cast<char*>(placeholders[type]);
+    *size = sizeof placeholders[type];
+    return true;
+}
+
+
+OSThread*
+OSGetCurrentThread()
+{
+    return &current_thread;
+}
+
+
+const char*
+OSGetThreadName(OSThread* thread)
+{
+    return thread->name;
+}
+
+
+void
+OSSetThreadName(OSThread* thread,
+                const char* name)
+{
+    thread->name = name;
+}
+
+
+OSTime
+OSGetSystemTime()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+std::uint64_t
+OSGetTitleID()
+{
+    return title_id;
+}
+
+
+void*
+MEMAllocFromDefaultHeapEx(std::uint32_t size,
+                          int alignment)
+{
+    return allocate(size, alignment);
+}
+
+
+void
+MEMFreeToDefaultHeap(void* ptr)
+{
+    std::free(ptr);
+}
+
+
+// The arena is not used: blocks come from the host heap, only the free size is tracked.
+MEMHeapHandle
+MEMCreateExpHeapEx(void*,
+                   std::uint32_t size,
+                   std::uint32_t)
+{
+    auto heap = new MEMHeapHeader;
+    heap->free = size;
+    return heap;
+}
+
+
+void*
+MEMDestroyExpHeap(MEMHeapHandle heap)
+{
+    for (auto [ptr, size] : heap->blocks)
+        std::free(ptr);
+    delete heap;
+    return nullptr;
+}
+
+
+void*
+MEMAllocFromExpHeapEx(MEMHeapHandle heap,
+                      std::uint32_t size,
+                      int alignment)
+{
+    std::lock_guard lock{heap->mutex};
+    if (size > heap->free)
+        return nullptr;
+    void* ptr = allocate(size, alignment);
+    if (ptr) {
+        heap->free -= size;
+        heap->blocks[ptr] = size;
+    }
+    return ptr;
+}
+
+
+void
+MEMFreeToExpHeap(MEMHeapHandle heap,
+                 void* ptr)
+{
+    std::lock_guard lock{heap->mutex};
+    auto it = heap->blocks.find(ptr);
+    if (it == heap->blocks.end())
+        return;
+    heap->free += it->second;
+    heap->blocks.erase(it);
+    std::free(ptr);
+}
+
+
+std::uint32_t
+MEMGetTotalFreeSizeForExpHeap(MEMHeapHandle heap)
+{
+    std::lock_guard lock{heap->mutex};
+    return heap->free;
+}
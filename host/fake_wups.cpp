@@ -0,0 +1,50 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+
+#include <wupsxx/logger.hpp>
+
+#include "fake.hpp"
+
+
+namespace {
+
+    std::atomic_bool logging = false;
+
+} // namespace
+
+
+namespace fake {
+
+    void
+    set_logging(bool enabled)
+        noexcept
+    {
+        logging = enabled;
+    }
+
+} // namespace fake
+
+
+namespace wups::logger {
+
+    void
+    printf(const char* fmt, ...)
+    {
+        if (!logging)
+            return;
+        std::va_list args;
+        va_start(args, fmt);
+        std::vfprintf(stderr, fmt, args);
+        va_end(args);
+    }
+
+} // namespace wups::logger
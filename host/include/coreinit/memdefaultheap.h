@@ -0,0 +1,8 @@
+// Stand-in for wut's <coreinit/memdefaultheap.h>, for the host build.
+#pragma once
+
+#include <cstdint>
+
+void* MEMAllocFromDefaultHeapEx(std::uint32_t size, int alignment);
+
+void MEMFreeToDefaultHeap(void* ptr);
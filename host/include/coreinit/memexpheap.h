@@ -0,0 +1,16 @@
+// Stand-in for wut's <coreinit/memexpheap.h>, for the host build.
+#pragma once
+
+#include <cstdint>
+
+#include "memheap.h"
+
+MEMHeapHandle MEMCreateExpHeapEx(void* base, std::uint32_t size, std::uint32_t flags);
+
+void* MEMDestroyExpHeap(MEMHeapHandle heap);
+
+void* MEMAllocFromExpHeapEx(MEMHeapHandle heap, std::uint32_t size, int alignment);
+
+void MEMFreeToExpHeap(MEMHeapHandle heap, void* ptr);
+
+std::uint32_t MEMGetTotalFreeSizeForExpHeap(MEMHeapHandle heap);
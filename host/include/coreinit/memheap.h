@@ -0,0 +1,10 @@
+// Stand-in for wut's <coreinit/memheap.h>, for the host build.
+#pragma once
+
+struct MEMHeapHeader;
+
+typedef MEMHeapHeader* MEMHeapHandle;
+
+enum MEMHeapFlags : unsigned {
+    MEM_HEAP_FLAG_USE_LOCK = 1 << 2,
+};
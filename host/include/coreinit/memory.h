@@ -0,0 +1,16 @@
+// Stand-in for wut's <coreinit/memory.h>, for the host build.
+#pragma once
+
+#include <cstdint>
+
+typedef std::int32_t BOOL;
+
+enum OSSharedDataType : std::uint32_t {
+    OS_SHAREDDATATYPE_FONT_CHINESE   = 0,
+    OS_SHAREDDATATYPE_FONT_KOREAN    = 1,
+    OS_SHAREDDATATYPE_FONT_STANDARD  = 2,
+    OS_SHAREDDATATYPE_FONT_TAIWANESE = 3,
+};
+
+// The "real" function: hands out small placeholder buffers, not actual fonts.
+BOOL OSGetSharedData(OSSharedDataType type, std::uint32_t unused, void** buf, std::uint32_t* size);
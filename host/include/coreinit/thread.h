@@ -0,0 +1,13 @@
+// Stand-in for wut's <coreinit/thread.h>, for the host build.
+#pragma once
+
+// One per host thread.
+struct OSThread {
+    const char* name = nullptr;
+};
+
+OSThread* OSGetCurrentThread();
+
+const char* OSGetThreadName(OSThread* thread);
+
+void OSSetThreadName(OSThread* thread, const char* name);
@@ -0,0 +1,12 @@
+// Stand-in for wut's <coreinit/time.h>, for the host build.
+#pragma once
+
+#include <cstdint>
+
+// Here a tick is a nanosecond of the host's monotonic clock.
+typedef std::int64_t OSTime;
+
+OSTime OSGetSystemTime();
+
+#define OSTicksToMicroseconds(ticks) ((ticks) / 1000)
+#define OSMillisecondsToTicks(ms)    ((ms) * 1000000)
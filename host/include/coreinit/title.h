@@ -0,0 +1,6 @@
+// Stand-in for wut's <coreinit/title.h>, for the host build.
+#pragma once
+
+#include <cstdint>
+
+std::uint64_t OSGetTitleID();
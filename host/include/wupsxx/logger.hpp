@@ -0,0 +1,9 @@
+// Stand-in for libwupsxx's logger, for the host build.
+#pragma once
+
+namespace wups::logger {
+
+    // Prints to stderr, only when logging is enabled in the harness.
+    void printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+} // namespace wups::logger
@@ -0,0 +1,27 @@
+// Stand-in for libwupsxx's storage, for the host build: nothing is stored.
+#pragma once
+
+#include <string>
+
+namespace wups::storage {
+
+    template<typename T>
+    void
+    load_or_init(const std::string&, T& value, const T& default_value)
+    {
+        value = default_value;
+    }
+
+
+    template<typename T>
+    void
+    store(const std::string&, const T&)
+    {}
+
+
+    inline
+    void
+    save()
+    {}
+
+} // namespace wups::storage
@@ -0,0 +1,197 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <cinttypes>            // PRIx64
+#include <cstdio>               // snprintf()
+#include <cstdlib>              // strtoull()
+#include <exception>
+
+#include <wupsxx/logger.hpp>
+#include <wupsxx/storage.hpp>
+
+#include "cfg.hpp"
+
+
+namespace logger = wups::logger;
+
+
+namespace cfg {
+
+    namespace labels {
+        const char* enabled             = "Enabled";
+        const char* only_menu           = "Use custom fonts only for Wii U Menu";
+        const char* path_cn             = "Cn Font";
+        const char* path_kr             = "Kr Font";
+        const char* path_std            = "Std Font";
+        const char* path_tw             = "Tw Font";
+        const char* read_kib            = "Read chunk size (KiB)";
+        const char* restart_menu        = "Restart Wii U Menu when fonts change";
+        const char* merge_pua           = "Add button symbols from the system font";
+        const char* heap                = "Font heap (0=plugin, 1=system, 2=dedicated)";
+        const char* budget_mib          = "Font memory budget (MiB)";
+        const char* catalogue_order     = "Order (0=file, 1=family, 2=size, 3=glyphs)";
+        const char* catalogue_pua       = "Only fonts with button symbols";
+        const char* profile_enabled     = "Profile enabled";
+        const char* profile_set_current = "Use this profile for the current title";
+    }
+
+
+    namespace defaults {
+        const bool enabled   = true;
+        const bool only_menu = true;
+        const std::string path_cn  = "fs:/vol/external01/wiiu/fonts";
+        const std::string path_kr  = "fs:/vol/external01/wiiu/fonts";
+        const std::string path_std = "fs:/vol/external01/wiiu/fonts";
+        const std::string path_tw  = "fs:/vol/external01/wiiu/fonts";
+        const int  read_kib  = 128;
+        const bool restart_menu = false;
+        const bool merge_pua    = false;
+        const int  heap         = 0;
+        const int  budget_mib   = 16;
+        const int  catalogue_order = 0;
+        const bool catalogue_pua   = false;
+
+#define PROFILE(title) { false, false, title, path_cn, path_kr, path_std, path_tw }
+        const std::array<profile, max_profiles> profiles = {{
+                PROFILE("0005001010040000"), // Wii U Menu
+                PROFILE("0005001010047000"), // System Settings
+                PROFILE("0000000000000000"),
+                PROFILE("0000000000000000"),
+            }};
+#undef PROFILE
+    }
+
+
+    bool enabled   = defaults::enabled;
+    bool only_menu = defaults::only_menu;
+    std::string path_cn  = defaults::path_cn;
+    std::string path_kr  = defaults::path_kr;
+    std::string path_std = defaults::path_std;
+    std::string path_tw  = defaults::path_tw;
+    int  read_kib  = defaults::read_kib;
+    bool restart_menu = defaults::restart_menu;
+    bool merge_pua    = defaults::merge_pua;
+    int  heap         = defaults::heap;
+    int  budget_mib   = defaults::budget_mib;
+    int  catalogue_order = defaults::catalogue_order;
+    bool catalogue_pua   = defaults::catalogue_pua;
+    std::array<profile, max_profiles> profiles = defaults::profiles;
+
+
+    namespace {
+
+        std::string
+        profile_key(unsigned idx, const char* field)
+        {
+            return "profile" + std::to_string(idx + 1) + "_" + field;
+        }
+
+    } // namespace
+
+
+    void
+    load()
+    {
+        try {
+#define LOAD(x) wups::storage::load_or_init(#x, x, defaults::x)
+            LOAD(enabled);
+            LOAD(only_menu);
+            LOAD(path_cn);
+            LOAD(path_kr);
+            LOAD(path_std);
+            LOAD(path_tw);
+            LOAD(read_kib);
+            LOAD(restart_menu);
+            LOAD(merge_pua);
+            LOAD(heap);
+            LOAD(budget_mib);
+            LOAD(catalogue_order);
+            LOAD(catalogue_pua);
+#undef LOAD
+
+#define LOAD(x) wups::storage::load_or_init(profile_key(i, #x), p.x, d.x)
+            for (unsigned i = 0; i < max_profiles; ++i) {
+                auto& p = profiles[i];
+                const auto& d = defaults::profiles[i];
+                LOAD(enabled);
+                LOAD(title);
+                LOAD(path_cn);
+                LOAD(path_kr);
+                LOAD(path_std);
+                LOAD(path_tw);
+            }
+#undef LOAD
+        }
+        catch (std::exception& e) {
+            logger::printf("exception caught: %s\n", e.what());
+        }
+    }
+
+
+    void
+    save()
+    {
+        try {
+#define STORE(x) wups::storage::store(#x, x)
+            STORE(enabled);
+            STORE(only_menu);
+            STORE(path_cn);
+            STORE(path_kr);
+            STORE(path_std);
+            STORE(path_tw);
+            STORE(read_kib);
+            STORE(restart_menu);
+            STORE(merge_pua);
+            STORE(heap);
+            STORE(budget_mib);
+            STORE(catalogue_order);
+            STORE(catalogue_pua);
+#undef STORE
+
+#define STORE(x) wups::storage::store(profile_key(i, #x), p.x)
+            for (unsigned i = 0; i < max_profiles; ++i) {
+                const auto& p = profiles[i];
+                STORE(enabled);
+                STORE(title);
+                STORE(path_cn);
+                STORE(path_kr);
+                STORE(path_std);
+                STORE(path_tw);
+            }
+#undef STORE
+            wups::storage::save();
+        }
+        catch (std::exception& e) {
+            logger::printf("exception caught: %s\n", e.what());
+        }
+    }
+
+
+    std::uint64_t
+    parse_title(const std::string& str)
+        noexcept
+    {
+        if (str.size() != 16)
+            return 0;
+        char* end = nullptr;
+        std::uint64_t result = std::strtoull(str.c_str(), &end, 16);
+        if (end != str.c_str() + str.size())
+            return 0;
+        return result;
+    }
+
+
+    std::string
+    format_title(std::uint64_t title)
+    {
+        char buf[17];
+        std::snprintf(buf, sizeof buf, "%016" PRIx64, title);
+        return buf;
+    }
+
+} // namespace cfg
@@ -0,0 +1,99 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CFG_HPP
+#define CFG_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+
+namespace cfg {
+
+    // Number of per-title profiles, on top of the default font set.
+    inline constexpr unsigned max_profiles = 4;
+
+
+    struct profile {
+        bool enabled;
+        bool set_current;       // when true, the current title is assigned on menu close
+        std::string title;      // title ID, as 16 hex digits
+        std::string path_cn;
+        std::string path_kr;
+        std::string path_std;
+        std::string path_tw;
+    };
+
+
+    namespace labels {
+        extern const char* enabled;
+        extern const char* only_menu;
+        extern const char* path_cn;
+        extern const char* path_kr;
+        extern const char* path_std;
+        extern const char* path_tw;
+        extern const char* read_kib;
+        extern const char* restart_menu;
+        extern const char* merge_pua;
+        extern const char* heap;
+        extern const char* budget_mib;
+        extern const char* catalogue_order;
+        extern const char* catalogue_pua;
+        extern const char* profile_enabled;
+        extern const char* profile_set_current;
+    }
+
+
+    namespace defaults {
+        extern const bool enabled;
+        extern const bool only_menu;
+        extern const std::string path_cn;
+        extern const std::string path_kr;
+        extern const std::string path_std;
+        extern const std::string path_tw;
+        extern const int  read_kib;
+        extern const bool restart_menu;
+        extern const bool merge_pua;
+        extern const int  heap;
+        extern const int  budget_mib;
+        extern const int  catalogue_order;
+        extern const bool catalogue_pua;
+        extern const std::array<profile, max_profiles> profiles;
+    }
+
+
+    extern bool enabled;
+    extern bool only_menu;
+    extern std::string path_cn;
+    extern std::string path_kr;
+    extern std::string path_std;
+    extern std::string path_tw;
+    extern int  read_kib;
+    extern bool restart_menu;
+    extern bool merge_pua;
+    extern int  heap;
+    extern int  budget_mib;
+    extern int  catalogue_order;
+    extern bool catalogue_pua;
+    extern std::array<profile, max_profiles> profiles;
+
+
+    void load();
+
+    void save();
+
+
+    // Returns 0 if the string is not a valid title ID.
+    std::uint64_t parse_title(const std::string& str) noexcept;
+
+    std::string format_title(std::uint64_t title);
+
+} // namespace cfg
+
+#endif
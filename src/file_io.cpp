@@ -0,0 +1,262 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <cerrno>
+#include <cstdio>               // remove(), rename()
+#include <cstring>              // memcpy()
+#include <stdexcept>
+#include <string>
+#include <utility>              // exchange()
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_io.hpp"
+
+
+namespace file_io {
+
+    namespace {
+
+        [[noreturn]]
+        void
+        fail(const char* what,
+             const path_string& file_path)
+        {
+            throw std::runtime_error{std::string{what} + " \"" + file_path.c_str() + "\""};
+        }
+
+    } // namespace
+
+
+    path_string::path_string(std::string_view str)
+    {
+        *this += str;
+    }
+
+
+    path_string&
+    path_string::operator /=(std::string_view name)
+    {
+        if (len && buf[len - 1] != '/')
+            *this += "/";
+        return *this += name;
+    }
+
+
+    path_string&
+    path_string::operator +=(std::string_view str)
+    {
+        if (str.size() >= max_path - len)
+            throw std::runtime_error{"path is too long: " + std::string{view()}
+                                     + std::string{str}};
+        std::memcpy(buf.data() + len, str.data(), str.size());
+        len += str.size();
+        buf[len] = '\0';
+        return *this;
+    }
+
+
+    std::string_view
+    path_string::filename()
+        const noexcept
+    {
+        auto v = view();
+        auto slash = v.rfind('/');
+        return slash == v.npos ? v : v.substr(slash + 1);
+    }
+
+
+    std::string_view
+    path_string::stem()
+        const noexcept
+    {
+        auto name = filename();
+        auto dot = name.rfind('.');
+        if (dot == name.npos || dot == 0)
+            return name;
+        return name.substr(0, dot);
+    }
+
+
+    bool
+    path_string::has_extension(std::string_view ext)
+        const noexcept
+    {
+        auto name = filename();
+        if (name.size() <= ext.size())
+            return false;
+        auto tail = name.substr(name.size() - ext.size());
+        for (std::size_t i = 0; i < ext.size(); ++i) {
+            char c = tail[i];
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            if (c != ext[i])
+                return false;
+        }
+        return true;
+    }
+
+
+    path_string
+    operator /(path_string dir,
+               std::string_view name)
+    {
+        return dir /= name;
+    }
+
+
+    file::file(int fd)
+        noexcept :
+        fd{fd}
+    {}
+
+
+    file::file(file&& other)
+        noexcept :
+        fd{std::exchange(other.fd, -1)}
+    {}
+
+
+    file::~file()
+        noexcept
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+
+    file&
+    file::operator =(file&& other)
+        noexcept
+    {
+        if (this != &other) {
+            if (fd >= 0)
+                ::close(fd);
+            fd = std::exchange(other.fd, -1);
+        }
+        return *this;
+    }
+
+
+    file
+    file::open_regular(const path_string& file_path,
+                       std::size_t& size)
+    {
+        file f{::open(file_path.c_str(), O_RDONLY)};
+        if (!f) {
+            if (errno == ENOENT || errno == EISDIR || errno == ENOTDIR)
+                return {};
+            fail("cannot open", file_path);
+        }
+
+        struct stat st;
+        if (::fstat(f.fd, &st))
+            fail("cannot stat", file_path);
+        if (!S_ISREG(st.st_mode))
+            return {};
+
+        size = st.st_size;
+        return f;
+    }
+
+
+    file
+    file::create(const path_string& file_path)
+    {
+        file f{::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)};
+        if (!f)
+            fail("cannot create", file_path);
+        return f;
+    }
+
+
+    void
+    file::read(void* dest,
+               std::size_t size)
+    {
+        char* out = static_cast<char*>(dest);
+        while (size) {
+            const ssize_t r = ::read(fd, out, size);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                throw std::runtime_error{"could not read entire file"};
+            out += r;
+            size -= r;
+        }
+    }
+
+
+    void
+    file::seek(std::uint64_t offset)
+    {
+        if (::lseek(fd, offset, SEEK_SET) < 0)
+            throw std::runtime_error{"cannot seek in file"};
+    }
+
+
+    void
+    file::write(const void* src,
+                std::size_t size)
+    {
+        const char* in = static_cast<const char*>(src);
+        while (size) {
+            const ssize_t w = ::write(fd, in, size);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+                throw std::runtime_error{"could not write entire file"};
+            in += w;
+            size -= w;
+        }
+    }
+
+
+    void
+    file::close()
+    {
+        if (::close(std::exchange(fd, -1)))
+            throw std::runtime_error{"error closing file"};
+    }
+
+
+    bool
+    stat_regular(const path_string& file_path,
+                 std::uint64_t& size,
+                 std::int64_t& mtime)
+        noexcept
+    {
+        struct stat st;
+        if (::stat(file_path.c_str(), &st) || !S_ISREG(st.st_mode))
+            return false;
+        size = st.st_size;
+        mtime = st.st_mtime;
+        return true;
+    }
+
+
+    void
+    make_dir(const path_string& dir_path)
+    {
+        if (::mkdir(dir_path.c_str(), 0777) && errno != EEXIST)
+            fail("cannot create", dir_path);
+    }
+
+
+    void
+    replace(const path_string& old_path,
+            const path_string& new_path)
+    {
+        std::remove(new_path.c_str());
+        if (std::rename(old_path.c_str(), new_path.c_str()))
+            fail("cannot rename to", new_path);
+    }
+
+} // namespace file_io
@@ -0,0 +1,141 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FILE_IO_HPP
+#define FILE_IO_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+/*
+ * Just the file operations the loader needs, straight on top of the POSIX calls, without
+ * std::filesystem or stdio streams. Errors are thrown as std::runtime_error.
+ */
+
+namespace file_io {
+
+    // Includes the terminating null.
+    inline constexpr std::size_t max_path = 256;
+
+
+    // A path in a fixed-size buffer, so building one never allocates.
+    class path_string {
+
+        std::array<char, max_path> buf{};
+        std::size_t len = 0;
+
+    public:
+
+        path_string() noexcept = default;
+
+        path_string(std::string_view str);
+
+
+        // Appends a separator, then the name.
+        path_string& operator /=(std::string_view name);
+
+        path_string& operator +=(std::string_view str);
+
+
+        const char*
+        c_str()
+            const noexcept
+        {
+            return buf.data();
+        }
+
+
+        std::string_view
+        view()
+            const noexcept
+        {
+            return {buf.data(), len};
+        }
+
+
+        // Everything after the last '/'.
+        std::string_view filename() const noexcept;
+
+        // The filename without its last extension.
+        std::string_view stem() const noexcept;
+
+        // Case-insensitive; the extension includes the dot.
+        bool has_extension(std::string_view ext) const noexcept;
+
+    };
+
+
+    path_string operator /(path_string dir, std::string_view name);
+
+
+    class file {
+
+        int fd = -1;
+
+        explicit file(int fd) noexcept;
+
+    public:
+
+        file() noexcept = default;
+
+        file(file&& other) noexcept;
+
+        ~file() noexcept;
+
+        file& operator =(file&& other) noexcept;
+
+
+        // Returns a closed file if it doesn't exist, or is not a regular file.
+        static file open_regular(const path_string& file_path,
+                                 std::size_t& size);
+
+        // Truncates the file if it exists.
+        static file create(const path_string& file_path);
+
+
+        explicit
+        operator bool()
+            const noexcept
+        {
+            return fd >= 0;
+        }
+
+
+        // Reads exactly this many bytes, in as many calls as needed.
+        void read(void* dest, std::size_t size);
+
+        void seek(std::uint64_t offset);
+
+        void write(const void* src, std::size_t size);
+
+        // Reports the errors the destructor would ignore.
+        void close();
+
+    };
+
+
+    // False if it doesn't exist, or is not a regular file.
+    bool stat_regular(const path_string& file_path,
+                      std::uint64_t& size,
+                      std::int64_t& mtime) noexcept;
+
+
+    // Does nothing if the directory already exists.
+    void make_dir(const path_string& dir_path);
+
+
+    // Replaces any file that already has the new name.
+    void replace(const path_string& old_path,
+                 const path_string& new_path);
+
+} // namespace file_io
+
+#endif
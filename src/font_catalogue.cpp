@@ -0,0 +1,357 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <algorithm>            // ranges::sort()
+#include <cinttypes>            // PRId64, PRIu64, SCNd64, SCNu64
+#include <cstdio>               // remove(), snprintf(), sscanf()
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>               // make_shared(), unique_ptr
+#include <stdexcept>
+#include <utility>              // move()
+
+#include <dirent.h>
+#include <strings.h>            // strcasecmp()
+
+#include <wupsxx/logger.hpp>
+
+#include "file_io.hpp"
+#include "font_catalogue.hpp"
+#include "platform.hpp"
+#include "sfnt.hpp"
+
+
+namespace logger = wups::logger;
+
+
+namespace {
+
+    using file_io::path_string;
+
+    const path_string fonts_dir{"fs:/vol/external01/wiiu/fonts"};
+    const path_string cache_dir = fonts_dir / "cache";
+    const path_string catalogue_path = cache_dir / "catalogue.tsv";
+
+    // Changes whenever the line format does.
+    const char* header_line = "# System Font Replacer catalogue 1\n";
+
+
+    bool
+    has_extension(const char* name,
+                  const char* ext)
+        noexcept
+    {
+        const std::size_t len = std::strlen(name);
+        const std::size_t ext_len = std::strlen(ext);
+        if (len <= ext_len)
+            return false;
+        return !strcasecmp(name + len - ext_len, ext);
+    }
+
+
+    // Compressed fonts and patches are listed too, but can't be read without unpacking.
+    bool
+    is_font(const char* name)
+        noexcept
+    {
+        return has_extension(name, ".ttf")
+            || has_extension(name, ".lz4")
+            || has_extension(name, ".bps");
+    }
+
+
+    // Tabs and newlines would break the line format.
+    std::string
+    sanitize(std::string str)
+    {
+        for (auto& c : str)
+            if (static_cast<unsigned char>(c) < 0x20)
+                c = ' ';
+        return str;
+    }
+
+
+    std::map<std::string, catalogue_entry>
+    load_saved()
+    {
+        std::map<std::string, catalogue_entry> result;
+        std::string text;
+        try {
+            std::size_t size = 0;
+            auto f = file_io::file::open_regular(catalogue_path, size);
+            if (!f)
+                return result;
+            text.resize(size);
+            f.read(text.data(), size);
+        }
+        catch (std::exception& e) {
+            logger::printf("failed to load catalogue: %s\n", e.what());
+            return result;
+        }
+
+        if (!text.starts_with(header_line))
+            return result;
+
+        std::size_t pos = std::strlen(header_line);
+        while (pos < text.size()) {
+            std::size_t end = text.find('\n', pos);
+            if (end == text.npos)
+                break;          // an incomplete line
+            text[end] = '\0';
+            const char* line = text.c_str() + pos;
+            pos = end + 1;
+
+            catalogue_entry entry;
+            unsigned pua = 0;
+            int fields_end = 0;
+            if (std::sscanf(line, "%" SCNu64 "\t%" SCNd64 "\t%u\t%u\t%n",
+                            &entry.size,
+                            &entry.mtime,
+                            &entry.num_glyphs,
+                            &pua,
+                            &fields_end) != 4)
+                continue;
+            const char* names = line + fields_end;
+            const char* tab = std::strchr(names, '\t');
+            if (!tab)
+                continue;
+            entry.file.assign(names, tab);
+            entry.family = tab + 1;
+            entry.has_pua = pua;
+            result.emplace(entry.file, std::move(entry));
+        }
+        return result;
+    }
+
+
+    void
+    save(const std::vector<catalogue_entry>& entries)
+    {
+        std::string text = header_line;
+        for (const auto& entry : entries) {
+            char numbers[80];
+            std::snprintf(numbers, sizeof numbers,
+                          "%" PRIu64 "\t%" PRId64 "\t%u\t%u\t",
+                          entry.size,
+                          entry.mtime,
+                          entry.num_glyphs,
+                          unsigned{entry.has_pua});
+            text += numbers;
+            text += entry.file;
+            text += '\t';
+            text += entry.family;
+            text += '\n';
+        }
+
+        path_string tmp_path = catalogue_path;
+        tmp_path += ".tmp";
+        try {
+            file_io::make_dir(cache_dir);
+            auto f = file_io::file::create(tmp_path);
+            f.write(text.data(), text.size());
+            f.close();
+            file_io::replace(tmp_path, catalogue_path);
+        }
+        catch (std::exception& e) {
+            std::remove(tmp_path.c_str());
+            logger::printf("failed to save catalogue: %s\n", e.what());
+        }
+    }
+
+
+    // Only the table directory and three small tables are read, not the whole font.
+    void
+    read_details(catalogue_entry& entry)
+    {
+        try {
+            std::size_t size = 0;
+            auto f = file_io::file::open_regular(fonts_dir / entry.file, size);
+            if (!f)
+                throw std::runtime_error{"cannot open"};
+            auto read = [&f, size](std::uint32_t offset, std::uint32_t length)
+            {
+                if (offset > size || length > size - offset)
+                    throw std::runtime_error{"table is out of bounds"};
+                std::vector<std::byte> data(length);
+                f.seek(offset);
+                f.read(data.data(), length);
+                return data;
+            };
+            auto info = sfnt::read_info(read);
+            entry.family = sanitize(std::move(info.family));
+            if (entry.family.empty())
+                entry.family = "?";
+            entry.num_glyphs = info.num_glyphs;
+            entry.has_pua = info.covers_range;
+        }
+        catch (std::exception& e) {
+            // Remembered as unreadable until the file changes.
+            logger::printf("cannot catalogue \"%s\": %s\n", entry.file.c_str(), e.what());
+            entry.family.clear();
+            entry.num_glyphs = 0;
+            entry.has_pua = false;
+        }
+    }
+
+
+    // Sets changed when anything was added, modified or deleted since the saved catalogue.
+    std::vector<catalogue_entry>
+    refresh_catalogue(bool& changed)
+    {
+        std::vector<catalogue_entry> result;
+        try {
+            const std::uint64_t start = platform::now_us();
+            auto saved = load_saved();
+
+            std::unique_ptr<DIR, int (*)(DIR*)> dir{opendir(fonts_dir.c_str()), closedir};
+            if (!dir)
+                throw std::runtime_error{"cannot open \""
+                                         + std::string{fonts_dir.view()} + "\""};
+
+            unsigned num_read = 0;
+            bool added = false;
+            while (auto ent = readdir(dir.get())) {
+                if (!is_font(ent->d_name))
+                    continue;
+                catalogue_entry entry;
+                entry.file = ent->d_name;
+                try {
+                    if (!file_io::stat_regular(fonts_dir / entry.file, entry.size, entry.mtime))
+                        continue;
+                }
+                catch (std::exception& e) {
+                    // A name too long for path_string would abort the whole refresh.
+                    logger::printf("cannot catalogue \"%s\": %s\n", entry.file.c_str(), e.what());
+                    continue;
+                }
+
+                auto it = saved.find(entry.file);
+                if (it != saved.end()
+                    && it->second.size == entry.size
+                    && it->second.mtime == entry.mtime) {
+                    result.push_back(std::move(it->second));
+                    saved.erase(it);
+                    continue;
+                }
+                if (has_extension(ent->d_name, ".ttf")) {
+                    read_details(entry);
+                    ++num_read;
+                }
+                result.push_back(std::move(entry));
+                added = true;
+            }
+
+            // Anything left in the saved catalogue was deleted.
+            changed = added || !saved.empty();
+            if (changed)
+                save(result);
+
+            logger::printf("catalogue: %u fonts, %u read in %u ms\n",
+                           static_cast<unsigned>(result.size()),
+                           num_read,
+                           static_cast<unsigned>((platform::now_us() - start) / 1000));
+        }
+        catch (std::exception& e) {
+            logger::printf("failed to refresh catalogue: %s\n", e.what());
+        }
+        return result;
+    }
+
+
+    std::string
+    describe(const catalogue_entry& entry)
+    {
+        char details[128];
+        const unsigned kib = entry.size / 1024;
+        if (has_extension(entry.file.c_str(), ".lz4"))
+            std::snprintf(details, sizeof details, "(compressed, %u KiB)", kib);
+        else if (has_extension(entry.file.c_str(), ".bps"))
+            std::snprintf(details, sizeof details, "(patch, %u KiB)", kib);
+        else if (entry.family.empty())
+            std::snprintf(details, sizeof details, "(unreadable, %u KiB)", kib);
+        else
+            std::snprintf(details, sizeof details, "%s, %u KiB, %u glyphs%s",
+                          entry.family.c_str(),
+                          kib,
+                          entry.num_glyphs,
+                          entry.has_pua ? ", buttons" : "");
+        return details;
+    }
+
+
+    std::shared_ptr<const catalogue_listing> cached_listing;
+    catalogue_order cached_order = catalogue_order::file;
+    bool cached_only_pua = false;
+
+} // namespace
+
+
+void
+sort_catalogue(std::vector<catalogue_entry>& entries,
+               catalogue_order order)
+{
+    // Ties stay in file name order.
+    std::ranges::sort(entries, {}, &catalogue_entry::file);
+    switch (order) {
+    case catalogue_order::file:
+        break;
+    case catalogue_order::family:
+        std::ranges::stable_sort(entries, {}, &catalogue_entry::family);
+        break;
+    case catalogue_order::size:
+        std::ranges::stable_sort(entries, std::ranges::greater{}, &catalogue_entry::size);
+        break;
+    case catalogue_order::glyphs:
+        std::ranges::stable_sort(entries, std::ranges::greater{}, &catalogue_entry::num_glyphs);
+        break;
+    }
+}
+
+
+std::shared_ptr<const catalogue_listing>
+get_catalogue_listing(catalogue_order order,
+                      bool only_pua)
+{
+    bool changed = false;
+    auto entries = refresh_catalogue(changed);
+    if (cached_listing
+        && !changed
+        && order == cached_order
+        && only_pua == cached_only_pua)
+        return cached_listing;
+
+    sort_catalogue(entries, order);
+    if (only_pua)
+        std::erase_if(entries, [](const catalogue_entry& e) { return !e.has_pua; });
+
+    auto listing = std::make_shared<catalogue_listing>();
+    for (auto& entry : entries) {
+        listing->details.push_back(describe(entry));
+        listing->entries.push_back(std::move(entry));
+    }
+
+    cached_listing = std::move(listing);
+    cached_order = order;
+    cached_only_pua = only_pua;
+    return cached_listing;
+}
+
+
+std::string
+catalogue_font_path(const catalogue_entry& entry)
+{
+    return std::string{(fonts_dir / entry.file).view()};
+}
+
+
+std::string
+catalogue_no_font_path()
+{
+    return std::string{fonts_dir.view()};
+}
@@ -0,0 +1,69 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FONT_CATALOGUE_HPP
+#define FONT_CATALOGUE_HPP
+
+#include <cstdint>
+#include <memory>               // shared_ptr
+#include <string>
+#include <vector>
+
+
+/*
+ * A list of the fonts in SD:/wiiu/fonts, with a few details read from each .ttf font. It's
+ * saved in SD:/wiiu/fonts/cache/catalogue.tsv, so only new or modified fonts have to be
+ * read again.
+ */
+
+struct catalogue_entry {
+    std::string file;           // name inside the fonts folder
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    std::string family;         // empty if the font could not be read
+    unsigned num_glyphs = 0;
+    bool has_pua = false;       // maps something in the button symbols block
+};
+
+
+enum class catalogue_order : int {
+    file,
+    family,
+    size,
+    glyphs,
+};
+
+
+// The catalogue as the menu shows it, with a description of each font.
+struct catalogue_listing {
+    std::vector<catalogue_entry> entries;
+    std::vector<std::string> details;
+};
+
+
+void sort_catalogue(std::vector<catalogue_entry>& entries,
+                    catalogue_order order);
+
+
+/*
+ * Checks the fonts folder for changes, but only sorts and describes the fonts again when
+ * something changed, or the order or filter did. Never throws; errors are logged, and the
+ * fonts that could be listed are returned.
+ */
+std::shared_ptr<const catalogue_listing>
+get_catalogue_listing(catalogue_order order,
+                      bool only_pua);
+
+
+// Full path of the font, as the config stores it.
+std::string catalogue_font_path(const catalogue_entry& entry);
+
+// The fonts folder itself, which the config stores when no font is selected.
+std::string catalogue_no_font_path();
+
+#endif
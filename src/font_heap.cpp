@@ -0,0 +1,217 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <cstdlib>              // aligned_alloc(), free()
+#include <new>                  // bad_alloc
+#include <utility>              // exchange()
+
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/memexpheap.h>
+
+#include <wupsxx/logger.hpp>
+
+#include "font_heap.hpp"
+
+
+namespace logger = wups::logger;
+
+
+namespace font_heap {
+
+    namespace {
+
+        kind current_kind = kind::plugin;
+        std::size_t budget = 0;
+
+        std::size_t used = 0;
+        unsigned blocks = 0;
+
+        // The dedicated heap and its arena.
+        void* arena = nullptr;
+        std::size_t arena_size = 0;
+        MEMHeapHandle exp_heap = nullptr;
+        unsigned exp_blocks = 0;
+
+
+        void
+        destroy_dedicated()
+            noexcept
+        {
+            if (!exp_heap)
+                return;
+            MEMDestroyExpHeap(exp_heap);
+            MEMFreeToDefaultHeap(arena);
+            logger::printf("destroyed dedicated font heap (%u KiB)\n",
+                           static_cast<unsigned>(arena_size / 1024));
+            exp_heap = nullptr;
+            arena = nullptr;
+            arena_size = 0;
+        }
+
+
+        MEMHeapHandle
+        get_dedicated()
+        {
+            if (exp_heap)
+                return exp_heap;
+
+            arena = MEMAllocFromDefaultHeapEx(budget, 0x40);
+            if (!arena)
+                throw std::bad_alloc{};
+            exp_heap = MEMCreateExpHeapEx(arena, budget, MEM_HEAP_FLAG_USE_LOCK);
+            if (!exp_heap) {
+                MEMFreeToDefaultHeap(arena);
+                arena = nullptr;
+                throw std::bad_alloc{};
+            }
+            arena_size = budget;
+            logger::printf("created dedicated font heap (%u KiB)\n",
+                           static_cast<unsigned>(arena_size / 1024));
+            return exp_heap;
+        }
+
+
+        void*
+        allocate(kind k,
+                 std::size_t size,
+                 std::size_t alignment)
+        {
+            // The dedicated heap enforces the budget by itself.
+            if (k != kind::dedicated && used + size > budget)
+                throw std::bad_alloc{};
+
+            void* ptr = nullptr;
+            switch (k) {
+            case kind::plugin:
+                // aligned_alloc() requires the size to be a multiple of the alignment
+                ptr = std::aligned_alloc(alignment,
+                                         (size + alignment - 1) / alignment * alignment);
+                break;
+            case kind::system:
+                ptr = MEMAllocFromDefaultHeapEx(size, alignment);
+                break;
+            case kind::dedicated:
+                ptr = MEMAllocFromExpHeapEx(get_dedicated(), size, alignment);
+                if (ptr)
+                    ++exp_blocks;
+                break;
+            }
+            if (!ptr)
+                throw std::bad_alloc{};
+
+            used += size;
+            ++blocks;
+            return ptr;
+        }
+
+
+        void
+        deallocate(kind k,
+                   void* ptr,
+                   std::size_t size)
+            noexcept
+        {
+            switch (k) {
+            case kind::plugin:
+                std::free(ptr);
+                break;
+            case kind::system:
+                MEMFreeToDefaultHeap(ptr);
+                break;
+            case kind::dedicated:
+                MEMFreeToExpHeap(exp_heap, ptr);
+                if (!--exp_blocks && (current_kind != kind::dedicated
+                                      || arena_size != budget))
+                    destroy_dedicated();
+                break;
+            }
+            used -= size;
+            --blocks;
+        }
+
+    } // namespace
+
+
+    void
+    configure(kind k,
+              std::size_t new_budget)
+    {
+        current_kind = k;
+        budget = new_budget;
+        if (!exp_blocks && (k != kind::dedicated || arena_size != budget))
+            destroy_dedicated();
+    }
+
+
+    stats
+    get_stats()
+        noexcept
+    {
+        stats result;
+        result.used   = used;
+        result.budget = budget;
+        result.blocks = blocks;
+        if (current_kind == kind::dedicated && exp_heap)
+            result.free = MEMGetTotalFreeSizeForExpHeap(exp_heap);
+        else
+            result.free = used < budget ? budget - used : 0;
+        return result;
+    }
+
+} // namespace font_heap
+
+
+font_buffer::font_buffer(std::size_t size,
+                         std::size_t alignment) :
+    source{font_heap::current_kind}
+{
+    if (!size)
+        return;
+    ptr = static_cast<char*>(font_heap::allocate(source, size, alignment));
+    len = size;
+}
+
+
+font_buffer::font_buffer(font_buffer&& other)
+    noexcept :
+    ptr{std::exchange(other.ptr, nullptr)},
+    len{std::exchange(other.len, 0)},
+    source{other.source}
+{}
+
+
+font_buffer&
+font_buffer::operator =(font_buffer&& other)
+    noexcept
+{
+    if (this != &other) {
+        reset();
+        ptr    = std::exchange(other.ptr, nullptr);
+        len    = std::exchange(other.len, 0);
+        source = other.source;
+    }
+    return *this;
+}
+
+
+font_buffer::~font_buffer()
+    noexcept
+{
+    reset();
+}
+
+
+void
+font_buffer::reset()
+    noexcept
+{
+    if (ptr)
+        font_heap::deallocate(source, ptr, len);
+    ptr = nullptr;
+    len = 0;
+}
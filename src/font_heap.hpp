@@ -0,0 +1,102 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FONT_HEAP_HPP
+#define FONT_HEAP_HPP
+
+#include <cstddef>
+
+
+namespace font_heap {
+
+    enum class kind : int {
+        plugin,                 // plugin heap, through aligned_alloc()
+        system,                 // MEMAllocFromDefaultHeapEx()
+        dedicated,              // expanded heap, carved out of the default heap
+    };
+
+
+    struct stats {
+        std::size_t used;
+        std::size_t free;
+        std::size_t budget;
+        unsigned blocks;
+    };
+
+
+    // Only affects future allocations; existing blocks go back where they came from.
+    void configure(kind k, std::size_t budget);
+
+
+    stats get_stats() noexcept;
+
+} // namespace font_heap
+
+
+// A move-only buffer, allocated through font_heap.
+class font_buffer {
+
+    char* ptr = nullptr;
+    std::size_t len = 0;
+    font_heap::kind source = font_heap::kind::plugin;
+
+public:
+
+    static constexpr std::size_t default_alignment = 0x40;
+
+
+    font_buffer() noexcept = default;
+
+    // Throws std::bad_alloc if the heap or the budget can't fit it.
+    explicit
+    font_buffer(std::size_t size,
+                std::size_t alignment = default_alignment);
+
+    font_buffer(font_buffer&& other) noexcept;
+
+    font_buffer& operator =(font_buffer&& other) noexcept;
+
+    ~font_buffer() noexcept;
+
+
+    void reset() noexcept;
+
+
+    char*
+    data()
+        noexcept
+    {
+        return ptr;
+    }
+
+    const char*
+    data()
+        const noexcept
+    {
+        return ptr;
+    }
+
+
+    std::size_t
+    size()
+        const noexcept
+    {
+        return len;
+    }
+
+
+    bool
+    empty()
+        const noexcept
+    {
+        return !len;
+    }
+
+};
+
+#endif
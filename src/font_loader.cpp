@@ -0,0 +1,470 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <algorithm>            // clamp(), min()
+#include <array>
+#include <cstdint>
+#include <cstdio>               // remove(), snprintf()
+#include <cstring>              // memcmp()
+#include <memory>               // unique_ptr
+#include <new>                  // bad_alloc
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>              // move()
+
+#include <dirent.h>
+
+#include <wupsxx/logger.hpp>
+
+#include "bps.hpp"
+#include "cfg.hpp"
+#include "crc32.hpp"
+#include "file_io.hpp"
+#include "font_loader.hpp"
+#include "lz4.hpp"
+#include "platform.hpp"
+#include "sfnt.hpp"
+
+
+using file_io::path_string;
+
+namespace logger = wups::logger;
+
+
+namespace {
+
+    const path_string cache_dir{"fs:/vol/external01/wiiu/fonts/cache"};
+
+    // The compressor uses 256 KiB blocks; bigger ones only waste memory on staging.
+    constexpr std::uint32_t max_lz4_block_size = 1024 * 1024;
+
+
+    std::size_t
+    chunk_size()
+    {
+        return std::size_t(std::clamp(cfg::read_kib, 16, 1024)) * 1024;
+    }
+
+
+    // Every read goes straight into the destination, in requests of chunk_size().
+    void
+    read_chunked(file_io::file& f,
+                 void* dest,
+                 std::size_t size)
+    {
+        const std::size_t chunk = chunk_size();
+        char* out = static_cast<char*>(dest);
+        for (std::size_t offset = 0; offset < size;) {
+            std::size_t request = std::min(chunk, size - offset);
+            f.read(out + offset, request);
+            offset += request;
+        }
+    }
+
+
+    void
+    write_chunked(file_io::file& f,
+                  const void* src,
+                  std::size_t size)
+    {
+        const std::size_t chunk = chunk_size();
+        const char* in = static_cast<const char*>(src);
+        for (std::size_t offset = 0; offset < size;) {
+            std::size_t request = std::min(chunk, size - offset);
+            f.write(in + offset, request);
+            offset += request;
+        }
+    }
+
+
+    void
+    log_throughput(const char* what,
+                   const path_string& file_path,
+                   std::size_t size,
+                   std::uint64_t start_us)
+    {
+        const auto us = platform::now_us() - start_us;
+        logger::printf("%s \"%s\": %u bytes in %u ms (%u KiB/s, %u KiB chunks)\n",
+                       what,
+                       file_path.c_str(),
+                       static_cast<unsigned>(size),
+                       static_cast<unsigned>(us / 1000),
+                       static_cast<unsigned>(us ? size * 1'000'000ull / 1024 / us : 0),
+                       static_cast<unsigned>(chunk_size() / 1024));
+    }
+
+
+    std::optional<blob_t>
+    load_ttf(const path_string& font_path)
+    {
+        const std::uint64_t start = platform::now_us();
+
+        std::size_t size = 0;
+        auto f = file_io::file::open_regular(font_path, size);
+        if (!f)
+            return {};
+
+        // too small file is probably a mistake; corrupted FS or broken FTP transfer
+        if (size < 8)
+            throw std::runtime_error{"font file size is too small!"};
+
+        blob_t content(size);
+
+        // Check the magic on the first chunk, before reading the rest.
+        const std::size_t first = std::min(chunk_size(), size);
+        read_chunked(f, content.data(), first);
+        const char ttf_magic[4] = {0x00, 0x01, 0x00, 0x00};
+        if (std::memcmp(ttf_magic, content.data(), 4))
+            throw std::runtime_error{"no TTF magic in font file!"};
+        read_chunked(f, content.data() + first, size - first);
+
+        log_throughput("loaded", font_path, size, start);
+
+        return { std::move(content) };
+    }
+
+
+    std::optional<blob_t>
+    load_lz4(const path_string& font_path)
+    {
+        const std::uint64_t start = platform::now_us();
+
+        std::size_t file_size = 0;
+        auto f = file_io::file::open_regular(font_path, file_size);
+        if (!f)
+            return {};
+
+        std::byte raw_header[lz4::header_size];
+        f.read(raw_header, sizeof raw_header);
+        const auto header = lz4::parse_header(raw_header);
+        if (header.raw_size < 8)
+            throw std::runtime_error{"font file size is too small!"};
+
+        // The header is not trusted to size the allocations.
+        if (header.block_size == 0 || header.block_size > max_lz4_block_size)
+            throw std::runtime_error{"bad LZ4 block size in header"};
+        if (header.raw_size > font_heap::get_stats().budget)
+            throw std::runtime_error{"decompressed font is bigger than the font budget"};
+
+        // Each block is read into the staging buffer, and decompressed straight into
+        // the font buffer.
+        const std::size_t max_block = lz4::block_bound(header.block_size);
+        blob_t content;
+        std::vector<std::byte> staging;
+        try {
+            content = blob_t(header.raw_size);
+            staging.resize(max_block);
+        }
+        catch (std::bad_alloc&) {
+            throw std::runtime_error{"not enough memory to decompress the font"};
+        }
+        std::size_t offset = 0;
+        std::size_t remaining = file_size - lz4::header_size;
+        while (remaining) {
+            std::byte prefix[4];
+            if (remaining < 4)
+                throw std::runtime_error{"truncated LZ4 block"};
+            read_chunked(f, prefix, 4);
+            remaining -= 4;
+
+            std::uint32_t block_size = lz4::read_le32(prefix);
+            const bool stored = block_size & lz4::stored_flag;
+            block_size &= ~lz4::stored_flag;
+            if (block_size > max_block || block_size > remaining)
+                throw std::runtime_error{"bad LZ4 block size"};
+
+            const std::size_t out_size = std::min<std::size_t>(header.block_size,
+                                                               header.raw_size - offset);
+            std::span<std::byte> out{reinterpret_cast<std::byte*>(content.data()) + offset,
+                                     out_size};
+            if (stored) {
+                if (block_size != out_size)
+                    throw std::runtime_error{"bad stored LZ4 block"};
+                read_chunked(f, out.data(), block_size);
+            } else {
+                read_chunked(f, staging.data(), block_size);
+                if (lz4::decompress_block(std::span{staging.data(), block_size}, out)
+                    != out_size)
+                    throw std::runtime_error{"LZ4 block decompressed to the wrong size"};
+            }
+            remaining -= block_size;
+
+            if (offset == 0) {
+                const char ttf_magic[4] = {0x00, 0x01, 0x00, 0x00};
+                if (std::memcmp(ttf_magic, content.data(), 4))
+                    throw std::runtime_error{"no TTF magic in font file!"};
+            }
+
+            offset += out_size;
+            if (offset == header.raw_size)
+                break;
+        }
+
+        if (offset != header.raw_size)
+            throw std::runtime_error{"LZ4 data is incomplete"};
+
+        std::span<const std::byte> result{reinterpret_cast<const std::byte*>(content.data()),
+                                          content.size()};
+        if (calc_crc32(result) != header.raw_crc)
+            throw std::runtime_error{"CRC32 mismatch after decompression"};
+
+        log_throughput("decompressed", font_path, content.size(), start);
+        logger::printf("  (%u bytes compressed, %u%%)\n",
+                       static_cast<unsigned>(file_size),
+                       static_cast<unsigned>(file_size * 100ull / content.size()));
+
+        return { std::move(content) };
+    }
+
+
+    std::uint32_t
+    get_le32(const unsigned char* p)
+        noexcept
+    {
+        return std::uint32_t{p[0]}
+            | std::uint32_t{p[1]} << 8
+            | std::uint32_t{p[2]} << 16
+            | std::uint32_t{p[3]} << 24;
+    }
+
+
+    std::string
+    to_hex(std::uint32_t val)
+    {
+        char buf[9];
+        std::snprintf(buf, sizeof buf, "%08x", static_cast<unsigned>(val));
+        return buf;
+    }
+
+
+    std::span<const std::byte>
+    find_system_font(std::uintmax_t size,
+                     std::uint32_t crc)
+    {
+        for (auto slot : {slot_std, slot_cn, slot_kr, slot_tw}) {
+            auto font = platform::system_font(slot);
+            if (font.size() != size)
+                continue;
+            if (calc_crc32(font) == crc)
+                return font;
+        }
+        return {};
+    }
+
+
+    // The variable part of a cache name: "xxxxxxxx-xxxxxxxx.ttf", from two to_hex() keys.
+    bool
+    is_cache_key(std::string_view key)
+        noexcept
+    {
+        if (key.size() != 8 + 1 + 8 + 4 || !key.ends_with(".ttf") || key[8] != '-')
+            return false;
+        for (std::size_t i = 0; i < 17; ++i) {
+            if (i == 8)
+                continue;
+            const char c = key[i];
+            if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+                return false;
+        }
+        return true;
+    }
+
+
+    /*
+     * Once the font file or the system font changes, the old cache file can never be
+     * loaded again, so any cache file with the same prefix and a different key is deleted.
+     */
+    void
+    remove_stale_cache(const path_string& cache_path,
+                       std::string_view prefix)
+    {
+        std::unique_ptr<DIR, int (*)(DIR*)> dir{opendir(cache_dir.c_str()), closedir};
+        if (!dir)
+            return;
+        while (auto ent = readdir(dir.get())) {
+            const std::string_view name = ent->d_name;
+            if (!name.starts_with(prefix)
+                || !is_cache_key(name.substr(prefix.size()))
+                || name == cache_path.filename())
+                continue;
+            const path_string stale_path = cache_dir / name;
+            if (std::remove(stale_path.c_str()) == 0)
+                logger::printf("removed stale cache file \"%s\"\n", stale_path.c_str());
+        }
+    }
+
+
+    // The prefix is the part of the cache name that doesn't change with the key.
+    void
+    save_cache(const path_string& cache_path,
+               std::string_view prefix,
+               const blob_t& content)
+    {
+        path_string tmp_path = cache_path;
+        tmp_path += ".tmp";
+        try {
+            file_io::make_dir(cache_dir);
+
+            auto f = file_io::file::create(tmp_path);
+            write_chunked(f, content.data(), content.size());
+            f.close();
+
+            // Only a complete file ever gets the final name.
+            file_io::replace(tmp_path, cache_path);
+
+            remove_stale_cache(cache_path, prefix);
+        }
+        catch (std::exception& e) {
+            std::remove(tmp_path.c_str());
+            logger::printf("failed to save cache: %s\n", e.what());
+        }
+    }
+
+
+    std::optional<blob_t>
+    load_bps(const path_string& patch_path)
+    {
+        std::size_t patch_size = 0;
+        auto f = file_io::file::open_regular(patch_path, patch_size);
+        if (!f)
+            return {};
+
+        // Only the CRC32s at the end of the patch are needed to find the cached result.
+        if (patch_size < 4 + 3 + 12)
+            throw std::runtime_error{"patch file size is too small!"};
+        unsigned char trailer[12];
+        f.seek(patch_size - 12);
+        f.read(trailer, sizeof trailer);
+        const std::uint32_t crc_in    = get_le32(trailer);
+        const std::uint32_t crc_patch = get_le32(trailer + 8);
+
+        const std::string prefix = std::string{patch_path.stem()} + "-";
+        path_string cache_path = cache_dir / prefix;
+        cache_path += to_hex(crc_patch) + "-" + to_hex(crc_in) + ".ttf";
+        if (auto font = load_ttf(cache_path))
+            return font;
+
+        // No cached result, so apply the patch now.
+        const std::uint64_t start = platform::now_us();
+
+        std::vector<std::byte> patch(patch_size);
+        f.seek(0);
+        read_chunked(f, patch.data(), patch.size());
+        f = {};
+
+        auto info = bps::get_info(patch);
+        auto source = find_system_font(info.size_in, info.crc_in);
+        if (source.empty())
+            throw std::runtime_error{"no system font matches the patch"};
+
+        blob_t content(info.size_out);
+        bps::apply(patch, source, std::as_writable_bytes(std::span{content.data(), content.size()}));
+
+        log_throughput("applied", patch_path, content.size(), start);
+
+        save_cache(cache_path, prefix, content);
+
+        return { std::move(content) };
+    }
+
+
+    // Replaces the PUA block in the font with the one from the system font.
+    blob_t
+    merge_system_pua(blob_t&& content,
+                     const path_string& font_path)
+    {
+        const std::uint64_t start = platform::now_us();
+
+        const auto system_font = platform::system_font(slot_std);
+        if (system_font.empty()) {
+            logger::printf("cannot get system font to merge PUA symbols\n");
+            return std::move(content);
+        }
+
+        try {
+            const sfnt::font custom{std::as_bytes(std::span{content.data(), content.size()})};
+            const sfnt::font system{system_font};
+            sfnt::merge_stats stats;
+            auto merged = sfnt::merge(custom, system, {}, &stats);
+
+            blob_t result(merged.size());
+            merged.write(std::as_writable_bytes(std::span{result.data(), result.size()}));
+
+            log_throughput("merged PUA into", font_path, result.size(), start);
+            logger::printf("  (%u glyphs, %u code points added)\n",
+                           stats.glyphs_added,
+                           stats.code_points_added);
+            return result;
+        }
+        catch (sfnt::error& e) {
+            // The font is still usable, just without the symbols.
+            logger::printf("cannot merge PUA symbols into \"%s\": %s\n",
+                           font_path.c_str(), e.what());
+            return std::move(content);
+        }
+    }
+
+
+    std::optional<blob_t>
+    load_any(const path_string& font_path)
+    {
+        if (font_path.has_extension(".bps"))
+            return load_bps(font_path);
+        if (font_path.has_extension(".lz4"))
+            return load_lz4(font_path);
+        return load_ttf(font_path);
+    }
+
+
+    /*
+     * The merged font is cached on the SD card, under a name that changes whenever the
+     * source file is modified.
+     */
+    std::optional<blob_t>
+    load_with_pua(const path_string& font_path)
+    {
+        std::uint64_t size;
+        std::int64_t mtime;
+        if (!file_io::stat_regular(font_path, size, mtime))
+            return load_any(font_path);
+
+        const std::string prefix = std::string{font_path.stem()} + "-pua-";
+        path_string cache_path = cache_dir / prefix;
+        cache_path += to_hex(size) + "-" + to_hex(mtime) + ".ttf";
+        if (auto font = load_ttf(cache_path))
+            return font;
+
+        auto font = load_any(font_path);
+        if (!font)
+            return {};
+
+        blob_t merged = merge_system_pua(std::move(*font), font_path);
+        save_cache(cache_path, prefix, merged);
+        return { std::move(merged) };
+    }
+
+} // namespace
+
+
+std::optional<blob_t>
+try_load_font(const char* font_path)
+{
+    try {
+        const path_string p{font_path};
+        if (cfg::merge_pua)
+            return load_with_pua(p);
+        return load_any(p);
+    }
+    catch (std::exception& e) {
+        logger::printf("failed to load font file \"%s\": %s\n",
+                       font_path, e.what());
+        return {};
+    }
+}
@@ -0,0 +1,25 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FONT_LOADER_HPP
+#define FONT_LOADER_HPP
+
+#include <optional>
+
+#include "font_heap.hpp"
+
+
+// Note: buffers are aligned to the cache line, so the FS devoptab can read straight into
+// them.
+using blob_t = font_buffer;
+
+
+std::optional<blob_t>
+try_load_font(const char* font_path);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <cstdio>               // snprintf()
+#include <utility>              // move()
+
+#include <wups/config.h>
+
+#include "font_picker.hpp"
+
+
+font_picker::font_picker(const std::string& label,
+                         std::string& variable,
+                         const std::string& default_value,
+                         std::shared_ptr<const catalogue_listing> listing,
+                         std::size_t max_width) :
+    item{label},
+    variable(variable),
+    default_value{default_value},
+    listing{std::move(listing)},
+    max_width{max_width}
+{
+    find_variable();
+}
+
+
+std::unique_ptr<font_picker>
+font_picker::create(const std::string& label,
+                    std::string& variable,
+                    const std::string& default_value,
+                    std::shared_ptr<const catalogue_listing> listing,
+                    std::size_t max_width)
+{
+    return std::make_unique<font_picker>(label,
+                                         variable,
+                                         default_value,
+                                         std::move(listing),
+                                         max_width);
+}
+
+
+void
+font_picker::find_variable()
+{
+    const auto no_font = catalogue_no_font_path();
+    if (variable == no_font || variable == no_font + "/") {
+        index = 0;
+        return;
+    }
+    index = -1;
+    const auto& entries = listing->entries;
+    for (std::size_t i = 0; i < entries.size(); ++i)
+        if (catalogue_font_path(entries[i]) == variable) {
+            index = i + 1;
+            return;
+        }
+}
+
+
+void
+font_picker::select(int new_index)
+{
+    index = new_index;
+    if (index == 0)
+        variable = catalogue_no_font_path();
+    else
+        variable = catalogue_font_path(listing->entries[index - 1]);
+}
+
+
+std::string
+font_picker::describe(bool focused)
+    const
+{
+    std::string result;
+    if (index < 0)
+        result = variable.substr(variable.rfind('/') + 1);
+    else if (index == 0)
+        result = "(no font)";
+    else if (focused)
+        result = listing->details[index - 1];
+    else
+        result = listing->entries[index - 1].file;
+    if (result.empty())
+        result = "(none)";
+    if (result.size() > max_width)
+        result = result.substr(0, max_width - 3) + "...";
+    return result;
+}
+
+
+int
+font_picker::get_display(char* buf,
+                         std::size_t size)
+    const
+{
+    std::snprintf(buf, size, "%s", describe(false).c_str());
+    return 0;
+}
+
+
+int
+font_picker::get_focused_display(char* buf,
+                                 std::size_t size)
+    const
+{
+    const int count = listing->entries.size();
+    if (!count)
+        std::snprintf(buf, size, "< %s > (no fonts in the catalogue)", describe(true).c_str());
+    else if (index <= 0)
+        std::snprintf(buf, size, "< %s >", describe(true).c_str());
+    else
+        std::snprintf(buf, size, "< %s > %d/%d",
+                      describe(true).c_str(),
+                      index,
+                      count);
+    return 0;
+}
+
+
+void
+font_picker::on_input(WUPSConfigSimplePadData input)
+{
+    // Position 0 is "no font", so there's always something to pick.
+    const int count = listing->entries.size();
+    if (input.buttons_d & WUPS_CONFIG_BUTTON_LEFT)
+        select(index <= 0 ? count : index - 1);
+    else if (input.buttons_d & WUPS_CONFIG_BUTTON_RIGHT)
+        select(index >= count ? 0 : index + 1);
+}
+
+
+void
+font_picker::restore()
+{
+    variable = default_value;
+    find_variable();
+}
@@ -0,0 +1,70 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FONT_PICKER_HPP
+#define FONT_PICKER_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <wupsxx/item.hpp>
+
+#include "font_catalogue.hpp"
+
+
+/*
+ * Picks a font from the catalogue, instead of browsing the folder: left and right step
+ * through a "no font" entry, then the fonts in the catalogue's order and filter. A font
+ * that isn't in the list (e.g. from another folder) is kept until another one is picked.
+ */
+class font_picker : public wups::config::item {
+
+    std::string& variable;
+    const std::string default_value;
+    std::shared_ptr<const catalogue_listing> listing;
+    std::size_t max_width;
+    int index = -1;             // 0 is "no font", -1 when the variable is not in the list
+
+
+    void find_variable();
+
+    void select(int new_index);
+
+    // The file name, or the font's details when focused.
+    std::string describe(bool focused) const;
+
+public:
+
+    font_picker(const std::string& label,
+                std::string& variable,
+                const std::string& default_value,
+                std::shared_ptr<const catalogue_listing> listing,
+                std::size_t max_width);
+
+
+    static
+    std::unique_ptr<font_picker>
+    create(const std::string& label,
+           std::string& variable,
+           const std::string& default_value,
+           std::shared_ptr<const catalogue_listing> listing,
+           std::size_t max_width = 40);
+
+
+    int get_display(char* buf, std::size_t size) const override;
+
+    int get_focused_display(char* buf, std::size_t size) const override;
+
+    void on_input(WUPSConfigSimplePadData input) override;
+
+    void restore() override;
+
+};
+
+#endif
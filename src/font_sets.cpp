@@ -0,0 +1,349 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <algorithm>            // erase_if(), ranges::all_of(), ranges::find()
+#include <atomic>
+#include <cstring>              // strcmp()
+#include <map>
+#include <memory>               // unique_ptr
+#include <string>
+#include <utility>              // move()
+#include <vector>
+
+#include <wupsxx/logger.hpp>
+
+#include "font_sets.hpp"
+#include "platform.hpp"
+
+
+namespace logger = wups::logger;
+
+
+namespace {
+
+    /*
+     * Everything the OSGetSharedData() hook needs, copied out of the config when the
+     * snapshot is published, and never modified afterwards; except for handed_out, that
+     * only the hook sets.
+     */
+    struct snapshot {
+        std::array<font_view, num_slots> fonts;
+        bool skip_swkbd;
+        unsigned generation;
+        // One bit per slot: the title got that font, and may use it until it ends.
+        mutable std::atomic_uint handed_out = 0;
+    };
+
+
+    // The hook does a single load from this; only the menu and application threads store.
+    std::atomic<const snapshot*> active_snapshot = nullptr;
+
+    // Incremented every time activate_font_set() publishes, even a null snapshot.
+    unsigned generation = 0;
+
+    /*
+     * Every snapshot published, including the active one. The hook might still be using
+     * an old one, so they're only freed by reclaim_font_sets(), or when the title ends.
+     */
+    std::vector<std::unique_ptr<const snapshot>> retired_snapshots;
+
+    // Fonts the hook returned to the running title, from snapshots already freed.
+    std::vector<const char*> pinned_fonts;
+
+
+    // Every font file is loaded only once, and shared by all font sets that use it.
+    std::map<std::string, blob_t> loaded_fonts;
+
+    // Enabled profiles come first, the default font set is last.
+    std::vector<font_set> font_sets;
+
+    font_config loaded_config{};
+
+    /*
+     * Buffers replaced by update_font_sets(), with the generation that was active when
+     * they were replaced. The running title might still hold pointers into them, so they
+     * are only freed by reclaim_font_sets() if the hook never returned them, or when the
+     * title ends.
+     */
+    struct retired_font {
+        unsigned generation;
+        blob_t blob;
+    };
+    std::vector<retired_font> retired_fonts;
+
+    struct retired_set_list {
+        unsigned generation;
+        std::vector<font_set> sets;
+    };
+    std::vector<retired_set_list> retired_sets;
+
+
+    void
+    retire_font(blob_t&& blob)
+    {
+        if (!blob.empty())
+            retired_fonts.push_back({generation, std::move(blob)});
+    }
+
+
+    const char* slot_names[num_slots] = { "Cn", "Kr", "Std", "Tw" };
+
+
+    // Note: the buffer never moves, even when its blob_t is moved to retired_fonts.
+    font_view
+    get_font(const std::string& font_path,
+             std::map<std::string, blob_t>& previous)
+    {
+        auto it = loaded_fonts.find(font_path);
+        if (it == loaded_fonts.end()) {
+            auto node = previous.extract(font_path);
+            if (node)
+                it = loaded_fonts.insert(std::move(node)).position;
+            else {
+                it = loaded_fonts.try_emplace(font_path).first;
+                if (auto font = try_load_font(font_path.c_str()))
+                    it->second = std::move(*font);
+            }
+        }
+        const blob_t& blob = it->second;
+        return {blob.data(), blob.size()};
+    }
+
+
+    font_set
+    make_font_set(std::uint64_t title,
+                  const font_config::paths_t& paths,
+                  bool skip_swkbd,
+                  std::map<std::string, blob_t>& previous)
+    {
+        font_set result{ title, {}, skip_swkbd };
+        for (unsigned slot = 0; slot < num_slots; ++slot)
+            result.fonts[slot] = get_font(paths[slot], previous);
+        return result;
+    }
+
+
+    void
+    log_changes(const char* name,
+                const font_config::paths_t& old_paths,
+                const font_config::paths_t& new_paths)
+    {
+        for (unsigned slot = 0; slot < num_slots; ++slot)
+            if (old_paths[slot] != new_paths[slot])
+                logger::printf("%s %s font: \"%s\"\n",
+                               name,
+                               slot_names[slot],
+                               new_paths[slot].c_str());
+    }
+
+} // namespace
+
+
+font_config
+font_config::current()
+{
+    font_config result;
+    result.enabled   = cfg::enabled;
+    result.only_menu = cfg::only_menu;
+    result.merge_pua = cfg::merge_pua;
+    result.paths     = { cfg::path_cn, cfg::path_kr, cfg::path_std, cfg::path_tw };
+    for (unsigned i = 0; i < cfg::max_profiles; ++i) {
+        const auto& p = cfg::profiles[i];
+        auto& r = result.profiles[i];
+        r.enabled = p.enabled;
+        r.title   = cfg::parse_title(p.title) & region_mask;
+        r.paths   = { p.path_cn, p.path_kr, p.path_std, p.path_tw };
+        if (r.enabled && !r.title)
+            logger::printf("profile %u has an invalid title ID: \"%s\"\n",
+                           i + 1, p.title.c_str());
+    }
+    return result;
+}
+
+
+bool
+update_font_sets(const font_config& config)
+{
+    // Note: loaded_config starts out disabled.
+    if (config == loaded_config || (!config.enabled && !loaded_config.enabled))
+        return false;
+
+    if (config.enabled) {
+        const bool was_enabled = loaded_config.enabled;
+        log_changes("default",
+                    was_enabled ? loaded_config.paths : font_config::paths_t{},
+                    config.paths);
+        for (unsigned i = 0; i < cfg::max_profiles; ++i) {
+            const auto& old_p = loaded_config.profiles[i];
+            const auto& new_p = config.profiles[i];
+            if (new_p.enabled)
+                log_changes(("profile " + std::to_string(i + 1)).c_str(),
+                            was_enabled && old_p.enabled ? old_p.paths : font_config::paths_t{},
+                            new_p.paths);
+        }
+    }
+
+    std::map<std::string, blob_t> previous = std::move(loaded_fonts);
+    loaded_fonts.clear();
+
+    // Fonts loaded with the other PUA setting can't be reused.
+    if (config.merge_pua != loaded_config.merge_pua) {
+        for (auto& [font_path, blob] : previous)
+            retire_font(std::move(blob));
+        previous.clear();
+    }
+
+    std::vector<font_set> new_sets;
+    try {
+        if (config.enabled) {
+            for (const auto& p : config.profiles)
+                if (p.enabled && p.title)
+                    new_sets.push_back(make_font_set(p.title,
+                                                     p.paths,
+                                                     p.title == wii_u_menu_id,
+                                                     previous));
+            new_sets.push_back(make_font_set(config.only_menu ? wii_u_menu_id : 0,
+                                             config.paths,
+                                             config.only_menu,
+                                             previous));
+        }
+    }
+    catch (...) {
+        // The current font sets might still point into these.
+        for (auto& [font_path, blob] : previous)
+            retire_font(std::move(blob));
+        throw;
+    }
+
+    // Whatever was not reused must be kept alive until it's reclaimed.
+    for (auto& [font_path, blob] : previous)
+        retire_font(std::move(blob));
+    if (!font_sets.empty())
+        retired_sets.push_back({generation, std::move(font_sets)});
+
+    font_sets = std::move(new_sets);
+    loaded_config = config;
+
+    return true;
+}
+
+
+bool
+activate_font_set(std::uint64_t title)
+{
+    title &= region_mask;
+    const font_set* found = nullptr;
+    for (const auto& set : font_sets)
+        if (!set.title || set.title == title) {
+            found = &set;
+            break;
+        }
+
+    ++generation;
+
+    if (!found || std::ranges::all_of(found->fonts, &font_view::empty)) {
+        active_snapshot.store(nullptr, std::memory_order_release);
+        return false;
+    }
+
+    retired_snapshots.push_back(std::make_unique<const snapshot>(found->fonts,
+                                                                 found->skip_swkbd,
+                                                                 generation));
+    active_snapshot.store(retired_snapshots.back().get(), std::memory_order_release);
+    return true;
+}
+
+
+font_view
+select_font(font_slot slot)
+    noexcept
+{
+    const snapshot* snap = active_snapshot.load(std::memory_order_acquire);
+    if (!snap)
+        return {};
+
+    if (snap->skip_swkbd) {
+
+#if 0
+        /*
+          This fragment will be enabled if/when:
+          - https://github.com/wiiu-env/WiiUPluginLoaderBackend/pull/86
+          - https://github.com/wiiu-env/WiiUPluginSystem/pull/76
+        */
+
+        // Avoid when inside WUPS config menu.
+        BOOL isMenuOpen = false;
+        WUPSConfigAPI_GetMenuOpen(&isMenuOpen);
+        if (isMenuOpen)
+            return {};
+#endif
+
+        // Avoid when using the on-screen keyboard inside the Wii U Menu.
+        const char* th_name = platform::current_thread_name();
+        if (th_name && !std::strcmp("MenSwkbdCalculator_Create", th_name))
+            return {};
+    }
+
+    const font_view font = snap->fonts[slot];
+    // Only the first time: after that, the cache line is just read.
+    const unsigned bit = 1u << slot;
+    if (!font.empty() && !(snap->handed_out.load(std::memory_order_relaxed) & bit))
+        snap->handed_out.fetch_or(bit, std::memory_order_relaxed);
+    return font;
+}
+
+
+void
+reclaim_font_sets()
+{
+    // Remember what the title got, before the snapshots that know it are freed.
+    for (const auto& snap : retired_snapshots) {
+        const unsigned handed_out = snap->handed_out.load(std::memory_order_relaxed);
+        for (unsigned slot = 0; slot < num_slots; ++slot) {
+            const char* font = snap->fonts[slot].data();
+            if ((handed_out & (1u << slot))
+                && std::ranges::find(pinned_fonts, font) == pinned_fonts.end())
+                pinned_fonts.push_back(font);
+        }
+    }
+
+    // Anything retired before the current generation can't be in the active snapshot.
+    std::erase_if(retired_snapshots,
+                  [](const auto& snap) { return snap->generation != generation; });
+    std::erase_if(retired_sets,
+                  [](const auto& r) { return r.generation != generation; });
+
+    unsigned num_freed = 0;
+    std::size_t size_freed = 0;
+    std::erase_if(retired_fonts,
+                  [&num_freed, &size_freed](const retired_font& r)
+                  {
+                      if (r.generation == generation
+                          || std::ranges::find(pinned_fonts, r.blob.data())
+                             != pinned_fonts.end())
+                          return false;
+                      ++num_freed;
+                      size_freed += r.blob.size();
+                      return true;
+                  });
+    if (num_freed)
+        logger::printf("reclaimed %u unused fonts (%u KiB)\n",
+                       num_freed,
+                       static_cast<unsigned>(size_freed / 1024));
+}
+
+
+void
+release_font_sets()
+{
+    active_snapshot.store(nullptr, std::memory_order_release);
+    retired_snapshots.clear();
+    pinned_fonts.clear();
+    retired_fonts.clear();
+    retired_sets.clear();
+}
@@ -0,0 +1,106 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FONT_SETS_HPP
+#define FONT_SETS_HPP
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "cfg.hpp"
+#include "font_loader.hpp"
+#include "font_slot.hpp"
+
+
+inline constexpr std::uint64_t wii_u_menu_id = 0x0005001010040000;
+inline constexpr std::uint64_t region_mask   = 0xfffffffffffffcff;
+
+
+/*
+ * The bytes of a loaded font; empty if there's no font. Unlike a pointer to the blob_t, it
+ * stays valid when the blob_t is moved into the retired list.
+ */
+using font_view = std::span<const char>;
+
+
+struct font_set {
+    std::uint64_t title;        // masked by region_mask; 0 means any title
+    std::array<font_view, num_slots> fonts;
+    bool skip_swkbd;
+};
+
+
+// The part of the configuration that decides which fonts get loaded, and where.
+struct font_config {
+
+    using paths_t = std::array<std::string, num_slots>;
+
+    struct profile {
+        bool enabled;
+        std::uint64_t title;
+        paths_t paths;
+
+        bool operator ==(const profile&) const = default;
+    };
+
+    bool enabled;
+    bool only_menu;
+    bool merge_pua;
+    paths_t paths;
+    std::array<profile, cfg::max_profiles> profiles;
+
+
+    static
+    font_config
+    current();
+
+
+    bool operator ==(const font_config&) const = default;
+
+};
+
+
+// Loads the fonts for the config, reusing any buffer already loaded from the same path.
+// Returns true if anything changed.
+bool
+update_font_sets(const font_config& config);
+
+
+/*
+ * Publishes a snapshot of the font set for the title, for select_font() to use. The
+ * previous snapshot is kept until reclaim_font_sets() or release_font_sets(). Returns
+ * false if select_font() would never return a custom font for this title.
+ */
+bool
+activate_font_set(std::uint64_t title);
+
+
+// The custom font the OSGetSharedData() hook should return for this slot, or empty to
+// let the system font through. Safe to call from any thread, it never blocks.
+font_view
+select_font(font_slot slot)
+    noexcept;
+
+
+/*
+ * Frees the snapshots, font sets and buffers replaced before the last activate_font_set(),
+ * except the fonts the hook already returned to the running title. Only call it long
+ * after that activate_font_set(), when the hook can't still be reading an older snapshot;
+ * the plugin does it when the config menu closes.
+ */
+void
+reclaim_font_sets();
+
+
+// Unpublishes the snapshot, and frees the buffers replaced by update_font_sets().
+void
+release_font_sets();
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef FONT_SLOT_HPP
+#define FONT_SLOT_HPP
+
+
+// The system fonts that can be replaced, one per OSGetSharedData() font type.
+enum font_slot : unsigned {
+    slot_cn,
+    slot_kr,
+    slot_std,
+    slot_tw,
+
+    num_slots
+};
+
+#endif
@@ -6,39 +6,45 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
-#include <cstdio>
-#include <cstring>              // strcmp
-#include <filesystem>
-#include <optional>
+#include <algorithm>            // clamp()
+#include <cstdint>
+#include <cstdio>               // snprintf()
 #include <stdexcept>
+#include <string>
 #include <utility>              // move()
 #include <vector>
 
 #include <coreinit/debug.h>
 #include <coreinit/memory.h>
-#include <coreinit/thread.h>
 #include <coreinit/title.h>
-#include <sysapp/switch.h>
+#include <function_patcher/function_patching.h>
+#include <sysapp/launch.h>
 
 #include <wups.h>
 
 #include <wupsxx/bool_item.hpp>
 #include <wupsxx/category.hpp>
-#include <wupsxx/file_item.hpp>
 #include <wupsxx/init.hpp>
+#include <wupsxx/int_item.hpp>
 #include <wupsxx/logger.hpp>
 #include <wupsxx/storage.hpp>
 #include <wupsxx/text_item.hpp>
 
+#include "alloc_stats.hpp"
+#include "cfg.hpp"
+#include "font_catalogue.hpp"
+#include "font_heap.hpp"
+#include "font_loader.hpp"
+#include "font_picker.hpp"
+#include "font_sets.hpp"
+#include "platform.hpp"
+#include "shared_data.hpp"
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
 
 
-using blob_t = std::vector<char>;
-using std::filesystem::path;
-
-
 namespace logger = wups::logger;
 
 
@@ -52,124 +58,184 @@ WUPS_USE_WUT_DEVOPTAB();
 WUPS_USE_STORAGE(PACKAGE_TARNAME);
 
 
-blob_t font_cn;
-blob_t font_kr;
-blob_t font_std;
-blob_t font_tw;
+// Snapshot of the font config when the menu was opened.
+font_config menu_font_config;
 
 
-namespace cfg {
+// Set once libfunctionpatcher is initialized.
+bool function_patcher_ready = false;
 
-    namespace labels {
-        const char* enabled   = "Enabled";
-        const char* only_menu = "Use custom fonts only for Wii U Menu";
-        const char* path_cn   = "Cn Font";
-        const char* path_kr   = "Kr Font";
-        const char* path_std  = "Std Font";
-        const char* path_tw   = "Tw Font";
-    }
+// Installs or removes the OSGetSharedData() hook; defined after the hook.
+void update_hook(bool wanted, std::uint64_t title);
 
+// Returns true if the hook was installed, and is now removed.
+bool remove_hook();
 
-    namespace defaults {
-        bool enabled   = true;
-        bool only_menu = true;
-        path path_cn   = "fs:/vol/external01/wiiu/fonts";
-        path path_kr   = "fs:/vol/external01/wiiu/fonts";
-        path path_std  = "fs:/vol/external01/wiiu/fonts";
-        path path_tw   = "fs:/vol/external01/wiiu/fonts";
-    }
 
+void
+configure_font_heap()
+{
+    auto kind = static_cast<font_heap::kind>(std::clamp(cfg::heap, 0, 2));
+    std::size_t budget = std::size_t(std::clamp(cfg::budget_mib, 1, 64)) * 1024 * 1024;
+    font_heap::configure(kind, budget);
+}
 
-    bool enabled   = defaults::enabled;
-    bool only_menu = defaults::only_menu;
-    path path_cn   = defaults::path_cn;
-    path path_kr   = defaults::path_kr;
-    path path_std  = defaults::path_std;
-    path path_tw   = defaults::path_tw;
-
-
-    void
-    load()
-    {
-        try {
-#define LOAD(x) wups::storage::load_or_init(#x, x, defaults::x)
-            LOAD(enabled);
-            LOAD(only_menu);
-            LOAD(path_cn);
-            LOAD(path_kr);
-            LOAD(path_std);
-            LOAD(path_tw);
-#undef LOAD
-        }
-        catch (std::exception& e) {
-            logger::printf("exception caught: %s\n", e.what());
-        }
-    }
 
+std::string
+format_font_memory()
+{
+    auto st = font_heap::get_stats();
+    char buf[64];
+    std::snprintf(buf, sizeof buf,
+                  "%u KiB used, %u KiB free (%u buffers)",
+                  static_cast<unsigned>(st.used / 1024),
+                  static_cast<unsigned>(st.free / 1024),
+                  st.blocks);
+    return buf;
+}
 
-    void
-    save()
-    {
-        try {
-#define STORE(x) wups::storage::store(#x, x)
-            STORE(enabled);
-            STORE(only_menu);
-            STORE(path_cn);
-            STORE(path_kr);
-            STORE(path_std);
-            STORE(path_tw);
-#undef STORE
-            wups::storage::save();
-        }
-        catch (std::exception& e) {
-            logger::printf("exception caught: %s\n", e.what());
-        }
-    }
 
+/*
+ * The order and filter options only take effect the next time the menu is opened, since
+ * the font pickers share the same listing.
+ */
+wups::config::category
+make_catalogue_category(const catalogue_listing& listing)
+{
+    wups::config::category cat{"Font catalogue"};
+
+    cat.add(wups::config::int_item::create(cfg::labels::catalogue_order,
+                                           cfg::catalogue_order,
+                                           cfg::defaults::catalogue_order,
+                                           0, 3));
+
+    cat.add(wups::config::bool_item::create(cfg::labels::catalogue_pua,
+                                            cfg::catalogue_pua,
+                                            cfg::defaults::catalogue_pua,
+                                            "yes", "no"));
+
+    cat.add(wups::config::text_item::create(std::to_string(listing.entries.size()) + " fonts"));
+    for (std::size_t i = 0; i < listing.entries.size(); ++i)
+        cat.add(wups::config::text_item::create(listing.entries[i].file, listing.details[i]));
 
-} // namespace cfg
+    return cat;
+}
 
 
 void
 menu_open(wups::config::category& root)
 {
     logger::guard guard{PACKAGE_NAME};
-    root.add(wups::config::text_item::create("NOTE: Changes might NOT take effect until the next boot."));
+
+    menu_font_config = font_config::current();
+
+    const auto listing =
+        get_catalogue_listing(static_cast<catalogue_order>(std::clamp(cfg::catalogue_order,
+                                                                      0, 3)),
+                              cfg::catalogue_pua);
+
+    root.add(wups::config::text_item::create("NOTE: The current title only sees new fonts after a restart."));
 
     root.add(wups::config::bool_item::create(cfg::labels::enabled,
                                              cfg::enabled,
                                              cfg::defaults::enabled,
                                              "yes", "no"));
 
-    root.add(wups::config::file_item::create(cfg::labels::path_std,
-                                             cfg::path_std,
-                                             cfg::defaults::path_std,
-                                             40,
-                                             {".ttf"}));
-
-    root.add(wups::config::file_item::create(cfg::labels::path_cn,
-                                             cfg::path_cn,
-                                             cfg::defaults::path_cn,
-                                             40,
-                                             {".ttf"}));
-
-    root.add(wups::config::file_item::create(cfg::labels::path_kr,
-                                             cfg::path_kr,
-                                             cfg::defaults::path_kr,
-                                             40,
-                                             {".ttf"}));
-
-    root.add(wups::config::file_item::create(cfg::labels::path_tw,
-                                             cfg::path_tw,
-                                             cfg::defaults::path_tw,
-                                             40,
-                                             {".ttf"}));
+    root.add(font_picker::create(cfg::labels::path_std,
+                                 cfg::path_std,
+                                 cfg::defaults::path_std,
+                                 listing));
+
+    root.add(font_picker::create(cfg::labels::path_cn,
+                                 cfg::path_cn,
+                                 cfg::defaults::path_cn,
+                                 listing));
+
+    root.add(font_picker::create(cfg::labels::path_kr,
+                                 cfg::path_kr,
+                                 cfg::defaults::path_kr,
+                                 listing));
+
+    root.add(font_picker::create(cfg::labels::path_tw,
+                                 cfg::path_tw,
+                                 cfg::defaults::path_tw,
+                                 listing));
 
     root.add(wups::config::bool_item::create(cfg::labels::only_menu,
                                              cfg::only_menu,
                                              cfg::defaults::only_menu,
                                              "yes", "no"));
 
+    root.add(wups::config::bool_item::create(cfg::labels::restart_menu,
+                                             cfg::restart_menu,
+                                             cfg::defaults::restart_menu,
+                                             "yes", "no"));
+
+    root.add(wups::config::bool_item::create(cfg::labels::merge_pua,
+                                             cfg::merge_pua,
+                                             cfg::defaults::merge_pua,
+                                             "yes", "no"));
+
+    for (unsigned i = 0; i < cfg::max_profiles; ++i) {
+        auto& p = cfg::profiles[i];
+        const auto& d = cfg::defaults::profiles[i];
+
+        wups::config::category cat{"Profile " + std::to_string(i + 1)};
+
+        cat.add(wups::config::text_item::create("Title ID", p.title));
+
+        cat.add(wups::config::bool_item::create(cfg::labels::profile_enabled,
+                                                p.enabled,
+                                                d.enabled,
+                                                "yes", "no"));
+
+        cat.add(wups::config::bool_item::create(cfg::labels::profile_set_current,
+                                                p.set_current,
+                                                d.set_current,
+                                                "yes", "no"));
+
+        cat.add(font_picker::create(cfg::labels::path_std,
+                                    p.path_std,
+                                    d.path_std,
+                                    listing));
+
+        cat.add(font_picker::create(cfg::labels::path_cn,
+                                    p.path_cn,
+                                    d.path_cn,
+                                    listing));
+
+        cat.add(font_picker::create(cfg::labels::path_kr,
+                                    p.path_kr,
+                                    d.path_kr,
+                                    listing));
+
+        cat.add(font_picker::create(cfg::labels::path_tw,
+                                    p.path_tw,
+                                    d.path_tw,
+                                    listing));
+
+        root.add(std::move(cat));
+    }
+
+    root.add(make_catalogue_category(*listing));
+
+    root.add(wups::config::text_item::create("Font memory", format_font_memory()));
+
+    root.add(wups::config::int_item::create(cfg::labels::heap,
+                                            cfg::heap,
+                                            cfg::defaults::heap,
+                                            0, 2));
+
+    root.add(wups::config::int_item::create(cfg::labels::budget_mib,
+                                            cfg::budget_mib,
+                                            cfg::defaults::budget_mib,
+                                            1, 64));
+
+    root.add(wups::config::int_item::create(cfg::labels::read_kib,
+                                            cfg::read_kib,
+                                            cfg::defaults::read_kib,
+                                            16, 1024));
+
     root.add(wups::config::text_item::create("Website",
                                              PACKAGE_URL));
 }
@@ -179,54 +245,38 @@ void
 menu_close()
 {
     logger::guard guard{PACKAGE_NAME};
-    cfg::save();
-}
 
+    for (auto& p : cfg::profiles) {
+        if (!p.set_current)
+            continue;
+        p.set_current = false;
+        p.title = cfg::format_title(OSGetTitleID());
+    }
+
+    cfg::save();
 
-std::optional<blob_t>
-try_load_font(const path& font_path)
-{
-    FILE* f = nullptr;
     try {
-        // silently exits if file doesn't exist, or is not a file
-        if (!exists(font_path) || !is_regular_file(font_path))
-            return {};
-
-        auto size = file_size(font_path);
-        // too small file is probably a mistake; corrupted FS or broken FTP transfer
-        if (size < 8)
-            throw std::runtime_error{"font file size is too small!"};
-
-        f = std::fopen(font_path.c_str(), "rb");
-        if (!f)
-            throw std::runtime_error{"cannot open \"" + font_path.string() + "\""};
-
-        const char ttf_magic[4] = {0x00, 0x01, 0x00, 0x00};
-        char file_magic[4];
-        auto res = std::fread(file_magic, 1, 4, f);
-        if (res != 4)
-            throw std::runtime_error{"cannot read TTF magic!"};
-        if (std::memcmp(ttf_magic, file_magic, 4))
-            throw std::runtime_error{"no TTF magic in font file!"};
-
-        std::rewind(f);
-
-        blob_t content(size);
-        res = std::fread(content.data(), 1, size, f);
-        if (static_cast<std::uintmax_t>(res) != size)
-            throw std::runtime_error{"could not load entire font file"};
-
-        std::fclose(f);
-        f = nullptr;
-
-        return { std::move(content) };
+        // The previous reload was a whole menu session ago, so the hook is done with it.
+        reclaim_font_sets();
+
+        auto new_config = font_config::current();
+        configure_font_heap();
+
+        if (new_config == menu_font_config)
+            return;
+
+        if (!update_font_sets(new_config))
+            return;
+
+        const std::uint64_t title = OSGetTitleID();
+        update_hook(activate_font_set(title), title);
+        logger::printf("reloaded fonts\n");
+
+        if (cfg::restart_menu && (title & region_mask) == wii_u_menu_id)
+            SYSLaunchMenu();
     }
     catch (std::exception& e) {
-        if (f)
-            std::fclose(f);
-        logger::printf("failed to load font file \"%s\": %s\n",
-                       font_path.c_str(), e.what());
-        return {};
+        logger::printf("ERROR: %s\n", e.what());
     }
 }
 
@@ -234,32 +284,66 @@ try_load_font(const path& font_path)
 INITIALIZE_PLUGIN()
 {
     logger::guard guard{PACKAGE_NAME};
+    const std::uint64_t start = platform::now_us();
 
     try {
+        auto status = FunctionPatcher_InitLibrary();
+        if (status != FUNCTION_PATCHER_RESULT_SUCCESS)
+            throw std::runtime_error{std::string{"FunctionPatcher_InitLibrary(): "}
+                                     + FunctionPatcher_GetStatusStr(status)};
+        function_patcher_ready = true;
+
         wups::config::init(PACKAGE_NAME, menu_open, menu_close);
         cfg::load();
 
-        if (!cfg::enabled)
-            return;
+        configure_font_heap();
+        update_font_sets(font_config::current());
+    }
+    catch (std::exception& e) {
+        logger::printf("ERROR: %s\n", e.what());
+    }
 
-        if (auto font = try_load_font(cfg::path_cn))
-            font_cn = std::move(*font);
+    logger::printf("initialized in %u ms\n",
+                   static_cast<unsigned>((platform::now_us() - start) / 1000));
 
-        if (auto font = try_load_font(cfg::path_kr))
-            font_kr = std::move(*font);
+#ifdef ENABLE_ALLOC_STATS
+    // Font buffers don't go through operator new, so they're reported separately.
+    alloc_stats::report([](const char* line) { logger::printf("%s\n", line); });
+    auto fh = font_heap::get_stats();
+    logger::printf("font heap: %u blocks, %u KiB used\n",
+                   fh.blocks,
+                   static_cast<unsigned>(fh.used / 1024));
+#endif
+}
 
-        if (auto font = try_load_font(cfg::path_std))
-            font_std = std::move(*font);
 
-        if (auto font = try_load_font(cfg::path_tw))
-            font_tw = std::move(*font);
-    }
-    catch (std::exception& e) {
-        logger::printf("ERROR: %s\n", e.what());
+DEINITIALIZE_PLUGIN()
+{
+    logger::guard guard{PACKAGE_NAME};
+
+    if (function_patcher_ready) {
+        if (remove_hook())
+            logger::printf("removed OSGetSharedData patch, plugin is unloading\n");
+        FunctionPatcher_DeInitLibrary();
     }
 }
 
 
+ON_APPLICATION_START()
+{
+    logger::guard guard{PACKAGE_NAME};
+
+    const std::uint64_t title = OSGetTitleID();
+    update_hook(activate_font_set(title), title);
+}
+
+
+ON_APPLICATION_ENDS()
+{
+    release_font_sets();
+}
+
+
 DECL_FUNCTION(BOOL,
               OSGetSharedData,
               OSSharedDataType type,
@@ -267,92 +351,97 @@ DECL_FUNCTION(BOOL,
               void** buf,
               uint32_t* size)
 {
-    if (unused == 0xefface) {
-        /*
-         * efface
-         *
-         * transitive verb: To cause to disappear (as anything impresses or inscribed upon
-         * a surface) by rubbing out, striking out, etc.; to erase; to render illegible or
-         * indiscernible.
-         */
-        unused = 0;
-        goto real_function;
-    }
-
-    if (!cfg::enabled)
-        goto real_function;
+    if (replace_shared_data(type, buf, size))
+        return true;
 
-    if (cfg::only_menu) {
+    return real_OSGetSharedData(type, unused, buf, size);
+}
 
-#if 0
-        /*
-          This fragment will be enabled if/when:
-          - https://github.com/wiiu-env/WiiUPluginLoaderBackend/pull/86
-          - https://github.com/wiiu-env/WiiUPluginSystem/pull/76
-         */
 
-        // Avoid when inside WUPS config menu.
-        BOOL isMenuOpen = false;
-        WUPSConfigAPI_GetMenuOpen(&isMenuOpen);
-        if (isMenuOpen)
-            goto real_function;
-#endif
+/*
+ * Instead of hooking OSGetSharedData() in every process, for every title, the hook is only
+ * installed while the running title has a custom font to get from it. With "only menu", it
+ * only goes into the Wii U Menu process.
+ */
+function_replacement_data_t shared_data_patch_all =
+    REPLACE_FUNCTION_FOR_PROCESS(OSGetSharedData,
+                                 LIBRARY_COREINIT,
+                                 OSGetSharedData,
+                                 FP_TARGET_PROCESS_ALL);
 
-        // Avoid when not inside the Wii U Menu.
-        const std::uint64_t wii_u_menu_id = 0x0005001010040000;
-        const std::uint64_t region_mask   = 0xfffffffffffffcff;
-        const std::uint64_t title = OSGetTitleID();
-        if ((title & region_mask) != wii_u_menu_id)
-            goto real_function;
-
-        // Avoid when using the on-screen keyboard inside the Wii U Menu.
-        OSThread* th_id = OSGetCurrentThread();
-        const char* th_name = OSGetThreadName(th_id);
-        if (th_name && !strcmp("MenSwkbdCalculator_Create", th_name))
-            goto real_function;
-    }
+function_replacement_data_t shared_data_patch_menu =
+    REPLACE_FUNCTION_FOR_PROCESS(OSGetSharedData,
+                                 LIBRARY_COREINIT,
+                                 OSGetSharedData,
+                                 FP_TARGET_PROCESS_WII_U_MENU);
 
-    switch (type) {
+PatchedFunctionHandle shared_data_handle = 0;
 
-    case OS_SHAREDDATATYPE_FONT_CHINESE:
-        if (font_cn.empty())
-            goto real_function;
-        *buf  = font_cn.data();
-        *size = font_cn.size();
-        return true;
+// Which of the two patches is installed.
+bool shared_data_menu_only = false;
 
-    case OS_SHAREDDATATYPE_FONT_KOREAN:
-        if (font_kr.empty())
-            goto real_function;
-        *buf  = font_kr.data();
-        *size = font_kr.size();
-        return true;
 
-    case OS_SHAREDDATATYPE_FONT_STANDARD:
-        if (font_std.empty())
-            goto real_function;
-        *buf  = font_std.data();
-        *size = font_std.size();
-        return true;
+bool
+remove_hook()
+{
+    if (!shared_data_handle)
+        return false;
+
+    set_real_shared_data(nullptr);
+    auto status = FunctionPatcher_RemoveFunctionPatch(shared_data_handle);
+    if (status != FUNCTION_PATCHER_RESULT_SUCCESS) {
+        set_real_shared_data(real_OSGetSharedData);
+        logger::printf("ERROR: cannot remove OSGetSharedData patch: %s\n",
+                       FunctionPatcher_GetStatusStr(status));
+        return false;
+    }
+    shared_data_handle = 0;
+    return true;
+}
 
-    case OS_SHAREDDATATYPE_FONT_TAIWANESE:
-        if (font_tw.empty())
-            goto real_function;
-        *buf  = font_tw.data();
-        *size = font_tw.size();
-        return true;
 
-    default:
-        ;
+void
+update_hook(bool wanted,
+            std::uint64_t title)
+{
+    if (!function_patcher_ready)
+        return;
+
+    const std::string title_str = cfg::format_title(title);
+    if (!wanted) {
+        if (remove_hook())
+            logger::printf("removed OSGetSharedData patch, title %s has no custom fonts\n",
+                           title_str.c_str());
+        return;
+    }
 
-    } // switch (type)
+    // A profile for another title still needs the hook in that title's process.
+    const bool menu_only = cfg::only_menu && (title & region_mask) == wii_u_menu_id;
+    if (shared_data_handle) {
+        if (menu_only == shared_data_menu_only) {
+            logger::printf("OSGetSharedData still patched, for title %s\n", title_str.c_str());
+            return;
+        }
+        // Patched for the wrong processes.
+        if (!remove_hook())
+            return;
+    }
 
- real_function:
-    return real_OSGetSharedData(type, unused, buf, size);
+    bool patched = false;
+    auto status = FunctionPatcher_AddFunctionPatch(menu_only
+                                                   ? &shared_data_patch_menu
+                                                   : &shared_data_patch_all,
+                                                   &shared_data_handle,
+                                                   &patched);
+    if (status != FUNCTION_PATCHER_RESULT_SUCCESS) {
+        shared_data_handle = 0;
+        logger::printf("ERROR: cannot patch OSGetSharedData: %s\n",
+                       FunctionPatcher_GetStatusStr(status));
+        return;
+    }
+    shared_data_menu_only = menu_only;
+    set_real_shared_data(real_OSGetSharedData);
+    logger::printf("patched OSGetSharedData for title %s%s\n",
+                   title_str.c_str(),
+                   menu_only ? ", in the Wii U Menu only" : "");
 }
-
-
-WUPS_MUST_REPLACE_FOR_PROCESS(OSGetSharedData,
-                              WUPS_LOADER_LIBRARY_COREINIT,
-                              OSGetSharedData,
-                              WUPS_FP_TARGET_PROCESS_ALL);
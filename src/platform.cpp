@@ -0,0 +1,64 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <coreinit/memory.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+#include "platform.hpp"
+#include "shared_data.hpp"
+
+
+namespace platform {
+
+    std::uint64_t
+    now_us()
+        noexcept
+    {
+        return OSTicksToMicroseconds(OSGetSystemTime());
+    }
+
+
+    const char*
+    current_thread_name()
+        noexcept
+    {
+        return OSGetThreadName(OSGetCurrentThread());
+    }
+
+
+    std::span<const std::byte>
+    system_font(font_slot slot)
+        noexcept
+    {
+        OSSharedDataType type;
+        switch (slot) {
+        case slot_cn:
+            type = OS_SHAREDDATATYPE_FONT_CHINESE;
+            break;
+        case slot_kr:
+            type = OS_SHAREDDATATYPE_FONT_KOREAN;
+            break;
+        case slot_std:
+            type = OS_SHAREDDATATYPE_FONT_STANDARD;
+            break;
+        case slot_tw:
+            type = OS_SHAREDDATATYPE_FONT_TAIWANESE;
+            break;
+        default:
+            return {};
+        }
+
+        void* buf = nullptr;
+        std::uint32_t size = 0;
+        if (!get_real_shared_data(type, &buf, &size) || !buf)
+            return {};
+        return { static_cast<const std::byte*>(buf), size };
+    }
+
+} // namespace platform
@@ -0,0 +1,39 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PLATFORM_HPP
+#define PLATFORM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "font_slot.hpp"
+
+
+/*
+ * The few console services used by the font loading and selection logic. Only
+ * platform.cpp talks to coreinit for them, so the rest can be built for other targets.
+ */
+
+namespace platform {
+
+    // Monotonic time, in microseconds.
+    std::uint64_t now_us() noexcept;
+
+
+    // Name of the calling thread; may be null.
+    const char* current_thread_name() noexcept;
+
+
+    // The real system font for this slot, bypassing our hook; empty if not available.
+    std::span<const std::byte> system_font(font_slot slot) noexcept;
+
+} // namespace platform
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "font_sets.hpp"
+#include "shared_data.hpp"
+
+
+namespace {
+
+    shared_data_fn real_shared_data = nullptr;
+
+} // namespace
+
+
+bool
+replace_shared_data(OSSharedDataType type,
+                    void** buf,
+                    std::uint32_t* size)
+    noexcept
+{
+    font_slot slot;
+    switch (type) {
+    case OS_SHAREDDATATYPE_FONT_CHINESE:
+        slot = slot_cn;
+        break;
+    case OS_SHAREDDATATYPE_FONT_KOREAN:
+        slot = slot_kr;
+        break;
+    case OS_SHAREDDATATYPE_FONT_STANDARD:
+        slot = slot_std;
+        break;
+    case OS_SHAREDDATATYPE_FONT_TAIWANESE:
+        slot = slot_tw;
+        break;
+    default:
+        return false;
+    } // switch (type)
+
+    const font_view font = select_font(slot);
+    if (font.empty())
+        return false;
+
+    *buf  = const_cast<char*>(font.data());
+    *size = font.size();
+    return true;
+}
+
+
+void
+set_real_shared_data(shared_data_fn fn)
+    noexcept
+{
+    real_shared_data = fn;
+}
+
+
+BOOL
+get_real_shared_data(OSSharedDataType type,
+                     void** buf,
+                     std::uint32_t* size)
+    noexcept
+{
+    if (real_shared_data)
+        return real_shared_data(type, 0, buf, size);
+    return OSGetSharedData(type, 0, buf, size);
+}
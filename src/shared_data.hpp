@@ -0,0 +1,50 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SHARED_DATA_HPP
+#define SHARED_DATA_HPP
+
+#include <cstdint>
+
+#include <coreinit/memory.h>
+
+
+/*
+ * What the OSGetSharedData() hook does, minus the function patching: if there's a custom
+ * font for this type, points buf and size to it and returns true. Otherwise returns false,
+ * and the real function must be called.
+ */
+bool
+replace_shared_data(OSSharedDataType type,
+                    void** buf,
+                    std::uint32_t* size)
+    noexcept;
+
+
+using shared_data_fn = BOOL (*)(OSSharedDataType type,
+                                std::uint32_t unused,
+                                void** buf,
+                                std::uint32_t* size);
+
+
+/*
+ * While the hook is installed, OSGetSharedData() itself would return the custom fonts;
+ * this is set to the saved real function then, and back to null when the hook is removed.
+ * Only the thread that installs the hook may call it.
+ */
+void set_real_shared_data(shared_data_fn fn) noexcept;
+
+
+// The system's own data, whether the hook is installed or not.
+BOOL
+get_real_shared_data(OSSharedDataType type,
+                     void** buf,
+                     std::uint32_t* size)
+    noexcept;
+
+#endif
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Times merge-fonts.py (FontForge) against the native merge-fonts tool, on one font pair.
+
+if [ $# -lt 2 ]; then
+    echo "Required arguments:  firstfont.ttf  secondfont.ttf"
+    exit 1
+fi
+
+tools_dir=$(dirname "$0")
+out_dir=$(mktemp -d)
+trap 'rm -rf "$out_dir"' EXIT
+
+make -s -C "$tools_dir" merge-fonts || exit 1
+
+now_ms() {
+    date +%s%3N
+}
+
+start=$(now_ms)
+fontforge -quiet "$tools_dir/../merge-fonts.py" "$1" "$2" "$out_dir/fontforge.ttf" > /dev/null || exit 1
+fontforge_ms=$(( $(now_ms) - start ))
+
+start=$(now_ms)
+"$tools_dir/merge-fonts" "$1" "$2" "$out_dir/native.ttf" > /dev/null || exit 1
+native_ms=$(( $(now_ms) - start ))
+
+echo "merge-fonts.py: $fontforge_ms ms, $(stat -c %s "$out_dir/fontforge.ttf") bytes"
+echo "merge-fonts:    $native_ms ms, $(stat -c %s "$out_dir/native.ttf") bytes"
@@ -0,0 +1,270 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Native replacement for merge-fonts.py, meant for building many fonts at once:
+ *
+ *   - the first font has priority;
+ *
+ *   - the PUA block (U+E000 to U+E099) is removed from the first font;
+ *
+ *   - like the script, the first font is scaled to the second font's em size, then every
+ *     missing symbol is filled in from the second font;
+ *
+ *   - with --keep-em, the first font keeps its em size (and its hinting), and the symbols
+ *     from the second font are scaled to it instead; this is faster, and the result
+ *     renders the same.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sfnt.hpp"
+
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::filesystem::path;
+
+using clock_type = std::chrono::steady_clock;
+
+
+namespace {
+
+    struct job {
+        path first;
+        path second;
+        path output;
+    };
+
+
+    struct result {
+        bool ok = false;
+        std::string message;
+        double ms = 0;
+        std::size_t size = 0;
+    };
+
+
+    std::mutex print_mutex;
+
+    bool keep_em = false;
+
+
+    void
+    usage(const char* prog)
+    {
+        cout << "Usage:\n"
+             << "  " << prog << " [-j jobs] [--keep-em] firstfont.ttf secondfont.ttf"
+                " [outputfont.ttf]\n"
+             << "  " << prog << " [-j jobs] [--keep-em] -b list.txt\n"
+             << "\n"
+             << "If \"outputfont.ttf\" is not specified, it will be set to "
+                "\"firstfont+secondfont.ttf\".\n"
+             << "\n"
+             << "With -b, each line of list.txt has the arguments for one merge:\n"
+             << "  firstfont.ttf secondfont.ttf [outputfont.ttf]\n"
+             << "Empty lines and lines starting with # are ignored.\n"
+             << "\n"
+             << "  -j jobs    number of merges to run in parallel (default: one per CPU)\n"
+             << "  --keep-em  keep the first font's em size, and scale the second font to it\n"
+             << "             (default: scale the first font to the second's, like the script)\n";
+    }
+
+
+    path
+    default_output(const path& first,
+                   const path& second)
+    {
+        return first.stem().string() + "+" + second.stem().string() + ".ttf";
+    }
+
+
+    std::vector<std::byte>
+    load_file(const path& file_path)
+    {
+        std::ifstream in{file_path, std::ios::binary};
+        if (!in)
+            throw std::runtime_error{"cannot open \"" + file_path.string() + "\""};
+        std::vector<std::byte> data(std::filesystem::file_size(file_path));
+        if (!in.read(reinterpret_cast<char*>(data.data()), data.size()))
+            throw std::runtime_error{"cannot read \"" + file_path.string() + "\""};
+        return data;
+    }
+
+
+    void
+    save_file(const path& file_path,
+              const std::vector<std::byte>& data)
+    {
+        path tmp_path = file_path;
+        tmp_path += ".tmp";
+        {
+            std::ofstream out{tmp_path, std::ios::binary};
+            if (!out.write(reinterpret_cast<const char*>(data.data()), data.size()))
+                throw std::runtime_error{"cannot write \"" + tmp_path.string() + "\""};
+        }
+        std::filesystem::rename(tmp_path, file_path);
+    }
+
+
+    result
+    run(const job& j)
+    {
+        result r;
+        const auto start = clock_type::now();
+        try {
+            auto first_data  = load_file(j.first);
+            auto second_data = load_file(j.second);
+            const sfnt::font first{first_data};
+            const sfnt::font second{second_data};
+
+            sfnt::merge_options options;
+            options.fill_missing = true;
+            if (!keep_em)
+                options.units_per_em = second.units_per_em();
+            sfnt::merge_stats stats;
+            auto output = sfnt::merge(first, second, options, &stats).write();
+            save_file(j.output, output);
+
+            r.ok = true;
+            r.size = output.size();
+            std::ostringstream msg;
+            msg << stats.glyphs_added << " glyphs, "
+                << stats.code_points_added << " code points added";
+            r.message = msg.str();
+        }
+        catch (std::exception& e) {
+            r.message = e.what();
+        }
+        r.ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+        return r;
+    }
+
+
+    std::vector<job>
+    read_list(const path& list_path)
+    {
+        std::ifstream in{list_path};
+        if (!in)
+            throw std::runtime_error{"cannot open \"" + list_path.string() + "\""};
+
+        std::vector<job> jobs;
+        std::string line;
+        unsigned line_num = 0;
+        while (std::getline(in, line)) {
+            ++line_num;
+            std::istringstream fields{line};
+            std::string first, second, output;
+            if (!(fields >> first) || first.starts_with('#'))
+                continue;
+            if (!(fields >> second))
+                throw std::runtime_error{list_path.string() + ":" + std::to_string(line_num)
+                                         + ": missing second font"};
+            fields >> output;
+            jobs.push_back({first,
+                            second,
+                            output.empty() ? default_output(first, second) : path{output}});
+        }
+        return jobs;
+    }
+
+} // namespace
+
+
+int
+main(int argc, char* argv[])
+try {
+    unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+    path list_path;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            num_threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg.starts_with("-j") && arg.size() > 2)
+            num_threads = std::max(1, std::atoi(arg.c_str() + 2));
+        else if (arg == "-b" && i + 1 < argc)
+            list_path = argv[++i];
+        else if (arg == "--keep-em")
+            keep_em = true;
+        else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else
+            args.push_back(arg);
+    }
+
+    std::vector<job> jobs;
+    if (!list_path.empty() && args.empty())
+        jobs = read_list(list_path);
+    else if (list_path.empty() && (args.size() == 2 || args.size() == 3))
+        jobs.push_back({args[0],
+                        args[1],
+                        args.size() == 3 ? path{args[2]} : default_output(args[0], args[1])});
+    else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    num_threads = std::min<std::size_t>(num_threads, jobs.size());
+
+    const auto start = clock_type::now();
+    std::atomic_size_t next_job = 0;
+    std::atomic_uint failures = 0;
+    double total_ms = 0;
+
+    auto worker = [&]
+    {
+        for (std::size_t i = next_job++; i < jobs.size(); i = next_job++) {
+            const auto& j = jobs[i];
+            auto r = run(j);
+            std::lock_guard guard{print_mutex};
+            total_ms += r.ms;
+            if (r.ok)
+                cout << j.output.string() << ": " << r.size << " bytes in "
+                     << r.ms << " ms (" << r.message << ")" << endl;
+            else {
+                ++failures;
+                cerr << j.first.string() << " + " << j.second.string() << ": "
+                     << r.message << endl;
+            }
+        }
+    };
+
+    std::vector<std::jthread> threads;
+    for (unsigned t = 1; t < num_threads; ++t)
+        threads.emplace_back(worker);
+    worker();
+    threads.clear();
+
+    const double wall_ms =
+        std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    if (jobs.size() > 1)
+        cout << jobs.size() << " merges on " << num_threads << " threads: "
+             << wall_ms << " ms total, " << total_ms / jobs.size() << " ms per merge"
+             << endl;
+
+    return failures ? 1 : 0;
+}
+catch (std::exception& e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+}
@@ -0,0 +1,253 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Checks bps::apply_parallel() and bps::apply_in_place() against bps::apply(), on random
+ * patches. The ranges are tiny, so most TargetCopy commands read from other ranges.
+ */
+
+#include <algorithm>            // min()
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "bps.hpp"
+#include "crc32.hpp"
+
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::byte;
+
+
+namespace {
+
+    unsigned failures = 0;
+
+
+    void
+    check(bool ok, const std::string& what)
+    {
+        if (!ok) {
+            cerr << "FAILED: " << what << endl;
+            ++failures;
+        }
+    }
+
+
+    using rng_t = std::mt19937;
+
+
+    std::size_t
+    random_size(rng_t& rng, std::size_t min, std::size_t max)
+    {
+        return std::uniform_int_distribution<std::size_t>{min, max}(rng);
+    }
+
+
+    std::vector<byte>
+    random_bytes(rng_t& rng, std::size_t size)
+    {
+        std::vector<byte> result(size);
+        // Few distinct values, so the patches have long matches to copy.
+        for (auto& b : result)
+            b = byte(random_size(rng, 0, 3));
+        return result;
+    }
+
+
+    struct writer {
+
+        std::vector<byte> data;
+
+
+        void
+        varint(std::uintmax_t val)
+        {
+            for (;;) {
+                const auto low = static_cast<std::uint8_t>(val & 0x7f);
+                val >>= 7;
+                if (!val) {
+                    data.push_back(byte(0x80 | low));
+                    return;
+                }
+                data.push_back(byte(low));
+                --val;
+            }
+        }
+
+
+        void
+        offset(std::intmax_t delta)
+        {
+            varint(delta < 0 ? (std::uintmax_t(-delta) << 1) | 1 : std::uintmax_t(delta) << 1);
+        }
+
+
+        void
+        u32(std::uint32_t val)
+        {
+            for (int i = 0; i < 4; ++i)
+                data.push_back(byte(val >> (8 * i)));
+        }
+
+    };
+
+
+    enum action : unsigned {
+        source_read,
+        target_read,
+        source_copy,
+        target_copy,
+    };
+
+
+    /*
+     * A patch with random commands. TargetCopy often overlaps its own output, like a run
+     * length encoding, and SourceCopy reads anywhere in the source.
+     */
+    std::vector<byte>
+    make_patch(rng_t& rng,
+               const std::vector<byte>& source,
+               std::size_t size_out)
+    {
+        std::vector<byte> target;
+        writer w;
+        w.data = {byte{'B'}, byte{'P'}, byte{'S'}, byte{'1'}};
+        w.varint(source.size());
+        w.varint(size_out);
+        w.varint(0);            // no metadata
+
+        std::size_t source_pos = 0;
+        std::size_t target_pos = 0;
+        while (target.size() < size_out) {
+            const std::size_t out_pos = target.size();
+            std::size_t length = std::min(random_size(rng, 1, 300), size_out - out_pos);
+            auto act = static_cast<action>(random_size(rng, 0, 3));
+            if (act == source_read && out_pos + length > source.size())
+                act = target_read;
+            if (act == target_copy && out_pos == 0)
+                act = source_copy;
+            std::size_t from = 0;
+            if (act == source_copy) {
+                from = random_size(rng, 0, source.size() - 1);
+                length = std::min(length, source.size() - from);
+            }
+
+            w.varint((length - 1) << 2 | act);
+            switch (act) {
+
+            case source_read:
+                target.insert(target.end(),
+                              source.begin() + out_pos,
+                              source.begin() + out_pos + length);
+                break;
+
+            case target_read:
+                for (std::size_t i = 0; i < length; ++i) {
+                    const byte b{static_cast<unsigned char>(random_size(rng, 0, 255))};
+                    w.data.push_back(b);
+                    target.push_back(b);
+                }
+                break;
+
+            case source_copy:
+                w.offset(std::intmax_t(from) - std::intmax_t(source_pos));
+                target.insert(target.end(),
+                              source.begin() + from,
+                              source.begin() + from + length);
+                source_pos = from + length;
+                break;
+
+            case target_copy: {
+                // Near the end of the output, so the copy often overlaps itself.
+                const std::size_t back = std::min(out_pos, random_size(rng, 1, 200));
+                from = out_pos - back;
+                w.offset(std::intmax_t(from) - std::intmax_t(target_pos));
+                for (std::size_t i = 0; i < length; ++i)
+                    target.push_back(target[from + i]);
+                target_pos = from + length;
+                break;
+            }
+
+            } // switch (act)
+        }
+
+        w.u32(calc_crc32(source));
+        w.u32(calc_crc32(target));
+        w.u32(calc_crc32(w.data));
+        return std::move(w.data);
+    }
+
+
+    // Each output size is checked smaller than, equal to, and larger than the source.
+    void
+    test_random_patches(unsigned seed)
+    {
+        rng_t rng{seed};
+        const std::size_t size_in = random_size(rng, 1000, 20000);
+        const auto source = random_bytes(rng, size_in);
+        for (std::size_t size_out : {size_in / 2, size_in, size_in * 2}) {
+            const auto patch = make_patch(rng, source, size_out);
+            const std::string what = "seed " + std::to_string(seed)
+                + ", " + std::to_string(size_in) + " -> " + std::to_string(size_out);
+
+            const auto expected = bps::apply(patch, source);
+            check(expected.size() == size_out, what + ": serial output size");
+
+            for (unsigned threads : {2u, 3u, 8u}) {
+                std::vector<byte> output(size_out);
+                bps::apply_parallel(patch, source, output, threads, 64);
+                check(output == expected,
+                      what + ": apply_parallel() on " + std::to_string(threads) + " threads");
+            }
+
+            std::vector<byte> buffer = source;
+            const auto result = bps::apply_in_place(patch,
+                                                    buffer,
+                                                    std::numeric_limits<std::size_t>::max());
+            check(result.applied, what + ": apply_in_place() applied");
+            check(buffer == expected, what + ": apply_in_place() output");
+
+            // When the side buffer is not allowed, the buffer is left untouched.
+            if (result.side_size) {
+                std::vector<byte> untouched = source;
+                const auto refused = bps::apply_in_place(patch, untouched, 0);
+                check(!refused.applied && untouched == source,
+                      what + ": refused apply_in_place() leaves the buffer alone");
+            }
+        }
+    }
+
+} // namespace
+
+
+int
+main()
+{
+    try {
+        for (unsigned seed = 1; seed <= 200; ++seed)
+            test_random_patches(seed);
+    }
+    catch (std::exception& e) {
+        cerr << "ERROR: " << e.what() << endl;
+        return 1;
+    }
+    if (failures) {
+        cerr << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "all checks passed" << endl;
+}
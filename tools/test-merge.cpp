@@ -0,0 +1,337 @@
+/*
+ * System Font Replacer - A plugin to temporarily replace the Wii U's system font.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Checks sfnt::merge() on tiny generated fonts, where the layout of every table is known.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sfnt.hpp"
+
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::byte;
+
+
+namespace {
+
+    unsigned failures = 0;
+
+
+    void
+    check(bool ok, const std::string& what)
+    {
+        if (!ok) {
+            cerr << "FAILED: " << what << endl;
+            ++failures;
+        }
+    }
+
+
+    struct writer {
+
+        std::vector<byte> data;
+
+
+        void
+        u16(std::uint16_t val)
+        {
+            data.push_back(byte(val >> 8));
+            data.push_back(byte(val));
+        }
+
+
+        void
+        u32(std::uint32_t val)
+        {
+            u16(val >> 16);
+            u16(val);
+        }
+
+
+        void
+        zeros(std::size_t n)
+        {
+            data.insert(data.end(), n, byte{0});
+        }
+
+    };
+
+
+    std::uint16_t
+    get_u16(std::span<const byte> data, std::size_t offset)
+    {
+        return std::to_integer<std::uint16_t>(data[offset]) << 8
+            |  std::to_integer<std::uint16_t>(data[offset + 1]);
+    }
+
+
+    std::uint32_t
+    get_u32(std::span<const byte> data, std::size_t offset)
+    {
+        return std::uint32_t{get_u16(data, offset)} << 16 | get_u16(data, offset + 2);
+    }
+
+
+    // A square with 4 on-curve points: exactly 34 bytes, so a glyf table with one of
+    // them has a size that is 2 mod 4.
+    std::vector<byte>
+    square()
+    {
+        writer w;
+        w.u16(1);      // numberOfContours
+        w.u16(0);      // xMin
+        w.u16(0);      // yMin
+        w.u16(100);    // xMax
+        w.u16(100);    // yMax
+        w.u16(3);      // endPtsOfContours[0]
+        w.u16(0);      // instructionLength
+        for (int i = 0; i < 4; ++i)
+            w.data.push_back(byte{0x01}); // on curve, long coordinates
+        for (int dx : {0, 100, 0, -100})
+            w.u16(dx);
+        for (int dy : {0, 0, 100, 0})
+            w.u16(dy);
+        return std::move(w.data);
+    }
+
+
+    /*
+     * Builds a font with short loca; each glyph is either empty or a square. The cmap maps
+     * each code point to a glyph index. The post table is only added when not empty.
+     */
+    std::vector<byte>
+    make_font(const std::vector<bool>& glyphs,
+              const sfnt::cmap_t& map,
+              std::vector<byte> post = {},
+              std::uint16_t units_per_em = 1000)
+    {
+        const auto glyph = square();
+        const std::uint16_t count = glyphs.size();
+
+        writer glyf;
+        writer loca;
+        writer hmtx;
+        for (bool filled : glyphs) {
+            loca.u16(glyf.data.size() / 2);
+            if (filled)
+                glyf.data.insert(glyf.data.end(), glyph.begin(), glyph.end());
+            hmtx.u16(120);
+            hmtx.u16(0);
+        }
+        loca.u16(glyf.data.size() / 2);
+
+        writer head;
+        head.u32(0x00010000);   // version
+        head.u32(0x00010000);   // fontRevision
+        head.u32(0);            // checkSumAdjustment
+        head.u32(0x5f0f3cf5);   // magicNumber
+        head.u16(0);            // flags
+        head.u16(units_per_em); // unitsPerEm
+        head.zeros(16);         // created, modified
+        head.u16(0);            // xMin
+        head.u16(0);            // yMin
+        head.u16(100);          // xMax
+        head.u16(100);          // yMax
+        head.u16(0);            // macStyle
+        head.u16(8);            // lowestRecPPEM
+        head.u16(2);            // fontDirectionHint
+        head.u16(0);            // indexToLocFormat: short
+        head.u16(0);            // glyphDataFormat
+
+        writer hhea;
+        hhea.u32(0x00010000);   // version
+        hhea.u16(800);          // ascender
+        hhea.u16(-200);         // descender
+        hhea.u16(0);            // lineGap
+        hhea.u16(120);          // advanceWidthMax
+        hhea.u16(0);            // minLeftSideBearing
+        hhea.u16(20);           // minRightSideBearing
+        hhea.u16(100);          // xMaxExtent
+        hhea.u16(1);            // caretSlopeRise
+        hhea.zeros(2 + 2 + 8 + 2);
+        hhea.u16(count);        // numberOfHMetrics
+
+        writer maxp;
+        maxp.u32(0x00005000);
+        maxp.u16(count);
+
+        writer cmap;
+        cmap.u16(0);            // version
+        cmap.u16(1);            // numTables
+        cmap.u16(3);            // Windows
+        cmap.u16(10);           // Unicode full repertoire
+        cmap.u32(12);
+        cmap.u16(12);           // format
+        cmap.u16(0);
+        cmap.u32(16 + 12 * map.size());
+        cmap.u32(0);            // language
+        cmap.u32(map.size());
+        for (auto [c, g] : map) {
+            cmap.u32(c);
+            cmap.u32(c);
+            cmap.u32(g);
+        }
+
+        sfnt::builder b;
+        b.add(sfnt::make_tag("cmap"), std::move(cmap.data));
+        b.add(sfnt::make_tag("glyf"), std::move(glyf.data));
+        b.add(sfnt::make_tag("head"), std::move(head.data));
+        b.add(sfnt::make_tag("hhea"), std::move(hhea.data));
+        b.add(sfnt::make_tag("hmtx"), std::move(hmtx.data));
+        b.add(sfnt::make_tag("loca"), std::move(loca.data));
+        b.add(sfnt::make_tag("maxp"), std::move(maxp.data));
+        if (!post.empty())
+            b.add(sfnt::make_tag("post"), std::move(post));
+        return b.write();
+    }
+
+
+    std::uint16_t
+    glyph_for(const sfnt::cmap_t& map, char32_t c)
+    {
+        for (auto [code, glyph] : map)
+            if (code == c)
+                return glyph;
+        return 0;
+    }
+
+
+    // An empty glyph imported right after an odd-sized glyf must stay empty.
+    void
+    test_empty_glyph_after_odd_glyf()
+    {
+        const auto first_data = make_font({true, false}, {{U'A', 1}});
+        const auto second_data = make_font({true, false, true},
+                                           {{U'\uE000', 1}, {U'\uE001', 2}});
+        const sfnt::font first{first_data};
+        const sfnt::font second{second_data};
+        check(first.table(sfnt::make_tag("glyf")).size() % 4 == 2,
+              "first font's glyf size is 2 mod 4");
+
+        sfnt::merge_stats stats;
+        const auto merged_data = sfnt::merge(first, second, {}, &stats).write();
+        const sfnt::font merged{merged_data};
+
+        check(stats.glyphs_added == 2, "two glyphs added");
+        check(merged.num_glyphs() == 4, "merged font has 4 glyphs");
+
+        const auto map = merged.cmap();
+        const auto empty_id  = glyph_for(map, U'\uE000');
+        const auto square_id = glyph_for(map, U'\uE001');
+        check(empty_id != 0, "U+E000 is mapped");
+        check(square_id != 0, "U+E001 is mapped");
+        check(merged.glyph(empty_id).empty(), "U+E000 is still an empty glyph");
+
+        const auto loca = merged.table(sfnt::make_tag("loca"));
+        const auto square_glyph = merged.glyph(square_id);
+        check(get_u32(loca, 4 * square_id) % 4 == 0, "U+E001 starts 4-aligned");
+        check(square_glyph.size() >= 10 && get_u16(square_glyph, 0) == 1,
+              "U+E001 is a simple glyph with one contour");
+        check(get_u16(square_glyph, 6) == 100 && get_u16(square_glyph, 8) == 100,
+              "U+E001 keeps its bounding box");
+
+        const auto glyf_size = merged.table(sfnt::make_tag("glyf")).size();
+        check(get_u32(loca, 4 * merged.num_glyphs()) == glyf_size,
+              "last loca entry is the glyf size");
+        for (unsigned id = 0; id < merged.num_glyphs(); ++id)
+            check(get_u32(loca, 4 * id) <= get_u32(loca, 4 * id + 4),
+                  "loca is sorted at glyph " + std::to_string(id));
+    }
+
+
+
+    // A post table too short for its header is kept, instead of being read past its end.
+    void
+    test_short_post()
+    {
+        writer post;
+        post.u32(0x00020000);   // version 2, but truncated
+        post.u16(0);
+        const auto first_data = make_font({true, false}, {{U'A', 1}}, post.data);
+        const auto second_data = make_font({true, true}, {{U'\uE000', 1}});
+        const sfnt::font first{first_data};
+        const sfnt::font second{second_data};
+
+        const auto merged_data = sfnt::merge(first, second).write();
+        const sfnt::font merged{merged_data};
+        const auto merged_post = merged.table(sfnt::make_tag("post"));
+        check(merged_post.size() == post.data.size()
+              && get_u32(merged_post, 0) == 0x00020000,
+              "short post table is copied unchanged");
+    }
+
+
+
+    // Like merge-fonts.py, the first font can be scaled to the second font's em size.
+    void
+    test_rescale_first()
+    {
+        const auto first_data = make_font({false, true}, {{U'A', 1}});
+        const auto second_data = make_font({false, true}, {{U'\uE000', 1}}, {}, 2000);
+        const sfnt::font first{first_data};
+        const sfnt::font second{second_data};
+
+        sfnt::merge_options options;
+        options.units_per_em = second.units_per_em();
+        const auto merged_data = sfnt::merge(first, second, options).write();
+        const sfnt::font merged{merged_data};
+
+        check(merged.units_per_em() == 2000, "merged font has the second font's em");
+        const auto map = merged.cmap();
+        const auto a_id   = glyph_for(map, U'A');
+        const auto pua_id = glyph_for(map, U'\uE000');
+        const auto a   = merged.glyph(a_id);
+        const auto pua = merged.glyph(pua_id);
+        check(a.size() >= 10 && get_u16(a, 6) == 200 && get_u16(a, 8) == 200,
+              "first font's glyph is scaled");
+        check(merged.get_metric(a_id).advance == 240, "first font's advance is scaled");
+        check(pua.size() >= 10 && get_u16(pua, 6) == 100 && get_u16(pua, 8) == 100,
+              "second font's glyph keeps its size");
+        check(merged.get_metric(pua_id).advance == 120, "second font's advance is kept");
+
+        const auto head = merged.table(sfnt::make_tag("head"));
+        const auto hhea = merged.table(sfnt::make_tag("hhea"));
+        check(get_u16(head, 40) == 200 && get_u16(head, 42) == 200,
+              "head bounding box is scaled");
+        check(get_u16(hhea, 4) == 1600 && get_u16(hhea, 6) == std::uint16_t(-400),
+              "ascender and descender are scaled");
+        check(get_u16(hhea, 10) == 240, "advanceWidthMax is scaled");
+    }
+
+} // namespace
+
+
+int
+main()
+{
+    try {
+        test_empty_glyph_after_odd_glyf();
+        test_short_post();
+        test_rescale_first();
+    }
+    catch (std::exception& e) {
+        cerr << "ERROR: " << e.what() << endl;
+        return 1;
+    }
+    if (failures) {
+        cerr << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "all checks passed" << endl;
+}